@@ -2,14 +2,85 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <unordered_map>
+#include <functional>
+#include <new>
+#include <cstdint>
+#include <algorithm>
+#include "Symbol.h"
+#include "Shape.h"
 
 // Forward declarations
 class ExprAST;
 class StmtAST;
 class FunctionAST;
+class ClassAST;
+class MemberAccessExprAST;
+struct RuntimeValue;
 
-using ExprPtr = std::unique_ptr<ExprAST>;
-using StmtPtr = std::unique_ptr<StmtAST>;
+// Builtin function (registered in StdLib.h); call sites keep pointers to them
+using NativeFunc = std::function<RuntimeValue(const std::vector<RuntimeValue>&)>;
+
+//===----------------------------------------------------------------------===//
+// Node Storage
+//===----------------------------------------------------------------------===//
+
+// Nodes live in their program's arena, so a pointer to one only destroys
+// it; the memory goes back when the arena does
+struct AstDelete {
+    template <typename T>
+    void operator()(T* node) const { node->~T(); }
+};
+
+template <typename T>
+using AstPtr = std::unique_ptr<T, AstDelete>;
+
+using ExprPtr = AstPtr<ExprAST>;
+using StmtPtr = AstPtr<StmtAST>;
+
+// Expression and statement nodes of one parse, carved from large blocks:
+// a module costs a few allocations instead of one per node, and a
+// function's nodes sit next to each other in the order they were parsed.
+// The program and every function and class parsed into it hold the arena,
+// so it outlives the nodes even when an import moves a function out.
+//
+// Follow-up, "AST indices and interned names": children are still pointers
+// and names still std::string members. Referring to children by 32-bit
+// index into the arena means rewriting every pass that walks the tree;
+// interning names into the arena saves little while most names fit in
+// std::string's inline buffer.
+class AstArena {
+public:
+    AstArena() = default;
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+
+    template <typename T, typename... Args>
+    AstPtr<T> make(Args&&... args) {
+        void* memory = allocate(sizeof(T), alignof(T));
+        return AstPtr<T>(new (memory) T(std::forward<Args>(args)...));
+    }
+
+private:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    uintptr_t next = 0;
+    uintptr_t end = 0;
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t start = (next + align - 1) & ~(uintptr_t)(align - 1);
+        if (blocks.empty() || start + size > end) {
+            size_t blockSize = std::max(kBlockSize, size + align);
+            blocks.emplace_back(new char[blockSize]);
+            next = (uintptr_t)blocks.back().get();
+            end = next + blockSize;
+            start = (next + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        next = start + size;
+        return (void*)start;
+    }
+};
 
 //===----------------------------------------------------------------------===//
 // Type Representation
@@ -21,60 +92,135 @@ struct TypeInfo {
     std::string genericParam;   // List<int> -> genericParam = "int"
 };
 
+//===----------------------------------------------------------------------===//
+// Node Kinds
+//===----------------------------------------------------------------------===//
+
+// Every node records its concrete kind so passes can dispatch with a switch
+// instead of probing each subclass with dynamic_cast.
+enum class ExprKind : unsigned char {
+    Number, String, FString, Variable, Binary, Unary, Call, MethodCall,
+    MemberAccess, New, Array, Lambda, Index, Self, Concat
+};
+
+enum class StmtKind : unsigned char {
+    Expr, Return, VarDecl, Assign, If, While, For, TryCatch, Throw, Break, Continue
+};
+
+// Operators are mapped from their tokens once, by the parser
+enum class BinaryOp : unsigned char {
+    Add, Sub, Mul, Div, Mod,
+    Equal, NotEqual, Less, Greater, LessEqual, GreaterEqual,
+    And, Or
+};
+
+enum class UnaryOp : unsigned char { Not, Negate };
+
+//===----------------------------------------------------------------------===//
+// Variable Resolution
+//===----------------------------------------------------------------------===//
+
+// Where a variable lives, filled in by the Resolver: a slot in the enclosing
+// function's frame or an index into the global table. Functions do not nest,
+// so a name is either local to the running frame or global.
+struct VarRef {
+    enum Kind : unsigned char { Unresolved, Local, Global };
+    Kind kind = Unresolved;
+    int index = -1;
+};
+
 //===----------------------------------------------------------------------===//
 // Expression Nodes
 //===----------------------------------------------------------------------===//
 
 class ExprAST {
 public:
+    const ExprKind kind;
     int line = 0;
+    explicit ExprAST(ExprKind k) : kind(k) {}
     virtual ~ExprAST() = default;
 };
 
-// Number literal: 42, 3.14
+// Number literal: 42, 3.14. Integral source literals are ints; folded
+// constants keep the type they were computed with.
 class NumberExprAST : public ExprAST {
 public:
     double value;
-    NumberExprAST(double val) : value(val) {}
+    bool isInt;
+    long long intValue;
+    NumberExprAST(double val)
+        : ExprAST(ExprKind::Number), value(val), isInt(val == (long long)val), intValue((long long)val) {}
+    NumberExprAST(long long val)
+        : ExprAST(ExprKind::Number), value((double)val), isInt(true), intValue(val) {}
+    NumberExprAST(double val, bool integral)
+        : ExprAST(ExprKind::Number), value(val), isInt(integral), intValue(integral ? (long long)val : 0) {}
 };
 
 // String literal: "hello"
 class StringExprAST : public ExprAST {
 public:
     std::string value;
-    StringExprAST(const std::string& val) : value(val) {}
-};
-
-// F-string literal: f"Hello {name}"
-class FStringExprAST : public ExprAST {
-public:
-    std::string value; // Raw string with {expr} placeholders
-    FStringExprAST(const std::string& val) : value(val) {}
+    Symbol symbol;      // Interned value; evaluates to its shared string
+    StringExprAST(const std::string& val) : ExprAST(ExprKind::String), value(val), symbol(val) {}
 };
 
 // Variable reference: x, count
 class VariableExprAST : public ExprAST {
 public:
     std::string name;
-    VariableExprAST(const std::string& n) : name(n) {}
+    VarRef ref;
+    VariableExprAST(const std::string& n) : ExprAST(ExprKind::Variable), name(n) {}
+};
+
+// The spec after ':' in an f-string placeholder, Python style:
+// [[fill]align][+][0][width][,][.precision][type], type one of d x f e % s
+struct FormatSpec {
+    char fill = ' ';
+    char align = 0;         // '<', '>', '^', or 0 for the type's default
+    bool plus = false;      // Sign on positive numbers too
+    bool zeroPad = false;   // Pad with zeros between the sign and the digits
+    bool grouping = false;  // Thousands separators
+    int width = 0;
+    int precision = -1;
+    char type = 0;
+};
+
+// One piece of an f-string: literal text, or a {expr} / {expr:spec} placeholder
+struct FStringPart {
+    std::string text;
+    ExprPtr expr;                           // null for literal text
+    std::unique_ptr<FormatSpec> spec;       // null without a ':spec'
+};
+
+// F-string literal: f"Hello {name}", f"{price * qty:.2f}"
+class FStringExprAST : public ExprAST {
+public:
+    std::string value; // Raw string with {expr} placeholders
+    std::vector<FStringPart> parts;
+    size_t sizeHint = 0;    // Expected length of the result, for one reserve
+    FStringExprAST(const std::string& val) : ExprAST(ExprKind::FString), value(val) {}
 };
 
 // Binary operation: a + b, x == y
 class BinaryExprAST : public ExprAST {
 public:
-    std::string op;  // "+", "-", "==", ".", etc.
+    BinaryOp op;
     ExprPtr lhs, rhs;
-    BinaryExprAST(const std::string& o, ExprPtr l, ExprPtr r)
-        : op(o), lhs(std::move(l)), rhs(std::move(r)) {}
+    BinaryExprAST(BinaryOp o, ExprPtr l, ExprPtr r)
+        : ExprAST(ExprKind::Binary), op(o), lhs(std::move(l)), rhs(std::move(r)) {}
+
+    // Set by the Resolver for s = s + x: s is cleared once both operands
+    // are evaluated, so its string can be appended to in place.
+    VarRef reusedVar;
 };
 
 // Unary operation: !x, -y
 class UnaryExprAST : public ExprAST {
 public:
-    std::string op;
+    UnaryOp op;
     ExprPtr operand;
-    UnaryExprAST(const std::string& o, ExprPtr e)
-        : op(o), operand(std::move(e)) {}
+    UnaryExprAST(UnaryOp o, ExprPtr e)
+        : ExprAST(ExprKind::Unary), op(o), operand(std::move(e)) {}
 };
 
 // Function call: print("hello"), add(1, 2)
@@ -83,7 +229,19 @@ public:
     std::string callee;
     std::vector<ExprPtr> args;
     CallExprAST(const std::string& c, std::vector<ExprPtr> a)
-        : callee(c), args(std::move(a)) {}
+        : ExprAST(ExprKind::Call), callee(c), args(std::move(a)) {}
+
+    // Set by the Resolver when the callee is a builtin. Otherwise the
+    // tree-walker caches the user function along with the epoch of the
+    // function registry it was found in.
+    const NativeFunc* native = nullptr;
+    FunctionAST* function = nullptr;
+    unsigned functionEpoch = 0;
+
+    // Set by the Resolver when the callee also names a variable in scope:
+    // f(x) calls the lambda the variable holds, and falls back to the
+    // function named f when it holds anything else
+    VarRef closure;
 };
 
 // Method call: obj.method(args)
@@ -93,7 +251,34 @@ public:
     std::string methodName;
     std::vector<ExprPtr> args;
     MethodCallExprAST(ExprPtr obj, const std::string& m, std::vector<ExprPtr> a)
-        : object(std::move(obj)), methodName(m), args(std::move(a)) {}
+        : ExprAST(ExprKind::MethodCall), object(std::move(obj)), methodName(m), args(std::move(a)) {}
+
+    // Builtins set by the Resolver
+    const NativeFunc* moduleFunc = nullptr;     // Math.sqrt(x): object names a module
+    const NativeFunc* stringMethod = nullptr;   // String.<methodName>, used on string receivers
+    const NativeFunc* arrayMethod = nullptr;    // xs.push(v), ... on array receivers
+    const NativeFunc* mapMethod = nullptr;      // m.set(k, v), ... on maps (objects without a class)
+
+    // Set by the Resolver for x = List.add(x, ...) and the like: x is
+    // cleared once the arguments are evaluated, so the builtin may update
+    // the container in place when nothing else refers to it.
+    VarRef reusedVar;
+    // The same for self.xs = List.add(self.xs, ...): args[0], a field that
+    // is also the assignment's target, is cleared in its object
+    MemberAccessExprAST* reusedField = nullptr;
+
+    // Inline cache: the receiver classes seen at this call site and the
+    // method each one resolved to (null if it has none). Sites that see more
+    // classes than fit fall back to the class's method table.
+    struct CacheEntry {
+        const ClassAST* cls;
+        FunctionAST* method;
+    };
+    static const int kCacheSize = 4;
+    CacheEntry cache[kCacheSize] = {};
+    int cacheCount = 0;
+
+    FunctionAST* lookupMethod(const ClassAST* cls);
 };
 
 // Member access: obj.field
@@ -101,8 +286,10 @@ class MemberAccessExprAST : public ExprAST {
 public:
     ExprPtr object;
     std::string memberName;
+    Symbol member;      // Interned memberName
+    FieldCache cache;   // Slot of member in the instances seen here
     MemberAccessExprAST(ExprPtr obj, const std::string& m)
-        : object(std::move(obj)), memberName(m) {}
+        : ExprAST(ExprKind::MemberAccess), object(std::move(obj)), memberName(m), member(m) {}
 };
 
 // New expression: new Person("John", 30)
@@ -111,7 +298,7 @@ public:
     std::string className;
     std::vector<ExprPtr> args;
     NewExprAST(const std::string& c, std::vector<ExprPtr> a)
-        : className(c), args(std::move(a)) {}
+        : ExprAST(ExprKind::New), className(c), args(std::move(a)) {}
 };
 
 // Array literal: [1, 2, 3]
@@ -119,7 +306,7 @@ class ArrayExprAST : public ExprAST {
 public:
     std::vector<ExprPtr> elements;
     ArrayExprAST(std::vector<ExprPtr> elems)
-        : elements(std::move(elems)) {}
+        : ExprAST(ExprKind::Array), elements(std::move(elems)) {}
 };
 
 // Lambda expression: x -> x * 2, (a, b) -> a + b
@@ -128,7 +315,14 @@ public:
     std::vector<std::string> params;
     ExprPtr body;
     LambdaExprAST(std::vector<std::string> p, ExprPtr b)
-        : params(std::move(p)), body(std::move(b)) {}
+        : ExprAST(ExprKind::Lambda), params(std::move(p)), body(std::move(b)) {}
+
+    // Frame layout set by the Resolver, like a function's: slot 0 holds the
+    // creating frame's self, parameters take slots 1..params.size(), and the
+    // captured variables follow. Each capture names the variable in the
+    // enclosing frame whose value is copied when the lambda is made.
+    std::vector<VarRef> captures;
+    int numSlots = 1;
 };
 
 // Array access: arr[0]
@@ -137,11 +331,27 @@ public:
     ExprPtr array;
     ExprPtr index;
     IndexExprAST(ExprPtr arr, ExprPtr idx)
-        : array(std::move(arr)), index(std::move(idx)) {}
+        : ExprAST(ExprKind::Index), array(std::move(arr)), index(std::move(idx)) {}
+};
+
+// A chain a + "x" + b + ... that is known to produce a string because one
+// operand is a string literal. Made by the Optimizer; the parts' text is
+// joined into one buffer instead of one intermediate string per +.
+class ConcatExprAST : public ExprAST {
+public:
+    std::vector<ExprPtr> parts;
+    ConcatExprAST(std::vector<ExprPtr> p) : ExprAST(ExprKind::Concat), parts(std::move(p)) {}
+
+    // Set by the Resolver for s = s + ...: as BinaryExprAST::reusedVar, but
+    // s is cleared once all parts are evaluated
+    VarRef reusedVar;
 };
 
 // Self/This reference
-class SelfExprAST : public ExprAST {};
+class SelfExprAST : public ExprAST {
+public:
+    SelfExprAST() : ExprAST(ExprKind::Self) {}
+};
 
 //===----------------------------------------------------------------------===//
 // Statement Nodes
@@ -149,7 +359,9 @@ class SelfExprAST : public ExprAST {};
 
 class StmtAST {
 public:
+    const StmtKind kind;
     int line = 0;
+    explicit StmtAST(StmtKind k) : kind(k) {}
     virtual ~StmtAST() = default;
 };
 
@@ -157,14 +369,14 @@ public:
 class ExprStmtAST : public StmtAST {
 public:
     ExprPtr expr;
-    ExprStmtAST(ExprPtr e) : expr(std::move(e)) {}
+    ExprStmtAST(ExprPtr e) : StmtAST(StmtKind::Expr), expr(std::move(e)) {}
 };
 
 // Return statement: return x + 1
 class ReturnStmtAST : public StmtAST {
 public:
     ExprPtr value;
-    ReturnStmtAST(ExprPtr v) : value(std::move(v)) {}
+    ReturnStmtAST(ExprPtr v) : StmtAST(StmtKind::Return), value(std::move(v)) {}
 };
 
 // Variable declaration: int x = 10
@@ -173,8 +385,21 @@ public:
     std::string name;
     TypeInfo type;
     ExprPtr initializer;
+    VarRef target;
     VarDeclStmtAST(const std::string& n, const TypeInfo& t, ExprPtr init)
-        : name(n), type(t), initializer(std::move(init)) {}
+        : StmtAST(StmtKind::VarDecl), name(n), type(t), initializer(std::move(init)) {}
+};
+
+// Assignment into an object or array: obj.field = value, arr[i] = value,
+// or with compound set, obj.field += value (op is Add or Sub)
+class AssignStmtAST : public StmtAST {
+public:
+    ExprPtr target;     // MemberAccessExprAST or IndexExprAST
+    ExprPtr value;
+    bool compound = false;
+    BinaryOp op = BinaryOp::Add;
+    AssignStmtAST(ExprPtr t, ExprPtr v)
+        : StmtAST(StmtKind::Assign), target(std::move(t)), value(std::move(v)) {}
 };
 
 // If statement
@@ -184,7 +409,7 @@ public:
     std::vector<StmtPtr> thenBody;
     std::vector<StmtPtr> elseBody;
     IfStmtAST(ExprPtr cond, std::vector<StmtPtr> thenB, std::vector<StmtPtr> elseB)
-        : condition(std::move(cond)), thenBody(std::move(thenB)), elseBody(std::move(elseB)) {}
+        : StmtAST(StmtKind::If), condition(std::move(cond)), thenBody(std::move(thenB)), elseBody(std::move(elseB)) {}
 };
 
 // While statement
@@ -193,7 +418,7 @@ public:
     ExprPtr condition;
     std::vector<StmtPtr> body;
     WhileStmtAST(ExprPtr cond, std::vector<StmtPtr> b)
-        : condition(std::move(cond)), body(std::move(b)) {}
+        : StmtAST(StmtKind::While), condition(std::move(cond)), body(std::move(b)) {}
 };
 
 // For loop: for i in range(10):
@@ -202,8 +427,12 @@ public:
     std::string varName;
     ExprPtr iterable;
     std::vector<StmtPtr> body;
+    VarRef var;
+    int iterSlot = -1;      // Hidden locals holding the iterable and position
+    int indexSlot = -1;
+    bool iterInPlace = false;   // iterSlot is the iterated local itself, never reassigned in the body
     ForStmtAST(const std::string& v, ExprPtr iter, std::vector<StmtPtr> b)
-        : varName(v), iterable(std::move(iter)), body(std::move(b)) {}
+        : StmtAST(StmtKind::For), varName(v), iterable(std::move(iter)), body(std::move(b)) {}
 };
 
 // Try-catch statement
@@ -214,11 +443,12 @@ public:
     std::string exceptionType;     // e.g., "Exception"
     std::vector<StmtPtr> catchBody;
     std::vector<StmtPtr> finallyBody;  // Optional finally block
+    VarRef exceptionRef;
     
     TryCatchStmtAST(std::vector<StmtPtr> tb, const std::string& var, 
                     const std::string& type, std::vector<StmtPtr> cb,
                     std::vector<StmtPtr> fb = {})
-        : tryBody(std::move(tb)), exceptionVar(var), exceptionType(type),
+        : StmtAST(StmtKind::TryCatch), tryBody(std::move(tb)), exceptionVar(var), exceptionType(type),
           catchBody(std::move(cb)), finallyBody(std::move(fb)) {}
 };
 
@@ -226,14 +456,20 @@ public:
 class ThrowStmtAST : public StmtAST {
 public:
     ExprPtr exception;
-    ThrowStmtAST(ExprPtr e) : exception(std::move(e)) {}
+    ThrowStmtAST(ExprPtr e) : StmtAST(StmtKind::Throw), exception(std::move(e)) {}
 };
 
 // Break statement
-class BreakStmtAST : public StmtAST {};
+class BreakStmtAST : public StmtAST {
+public:
+    BreakStmtAST() : StmtAST(StmtKind::Break) {}
+};
 
 // Continue statement
-class ContinueStmtAST : public StmtAST {};
+class ContinueStmtAST : public StmtAST {
+public:
+    ContinueStmtAST() : StmtAST(StmtKind::Continue) {}
+};
 
 //===----------------------------------------------------------------------===//
 // Top-Level Declarations
@@ -259,6 +495,7 @@ struct FieldDecl {
 // Function/Method definition
 class FunctionAST {
 public:
+    std::shared_ptr<AstArena> arena;    // Holds the body's nodes; declared first so it goes last
     AccessModifier access = AccessModifier::Public;
     bool isStatic = false;
     std::string name;
@@ -266,6 +503,11 @@ public:
     TypeInfo returnType;
     std::vector<StmtPtr> body;
 
+    // Frame layout set by the Resolver: slot 0 holds self, parameters
+    // (excluding self) take slots 1..arity, locals follow.
+    int arity = 0;
+    int numSlots = 1;
+
     FunctionAST(const std::string& n, std::vector<FuncArg> a, const TypeInfo& ret, std::vector<StmtPtr> b)
         : name(n), args(std::move(a)), returnType(ret), body(std::move(b)) {}
 };
@@ -273,14 +515,31 @@ public:
 // Class definition
 class ClassAST {
 public:
+    std::shared_ptr<AstArena> arena;    // Holds the field initializers
     std::string name;
     std::string parentClass;                          // Inheritance
     std::vector<std::string> interfaces;              // Implements
     std::vector<FieldDecl> fields;
     std::vector<std::unique_ptr<FunctionAST>> methods;
     std::unique_ptr<FunctionAST> constructor;         // __init__
+
+    // Filled in when the class is registered (Resolver::linkClasses)
+    ClassAST* parent = nullptr;
+    std::unordered_map<std::string, FunctionAST*> methodTable;  // Own and inherited
+    FunctionAST* initializer = nullptr;               // Own or inherited __init__
+    Shape* shape = nullptr;                           // Layout of new instances; null if too many fields
 };
 
+inline FunctionAST* MethodCallExprAST::lookupMethod(const ClassAST* cls) {
+    for (int i = 0; i < cacheCount; i++) {
+        if (cache[i].cls == cls) return cache[i].method;
+    }
+    auto it = cls->methodTable.find(methodName);
+    FunctionAST* method = it != cls->methodTable.end() ? it->second : nullptr;
+    if (cacheCount < kCacheSize) cache[cacheCount++] = {cls, method};
+    return method;
+}
+
 // Interface definition
 class InterfaceAST {
 public:
@@ -298,6 +557,8 @@ public:
 // Program: Root of AST
 class ProgramAST {
 public:
+    std::shared_ptr<AstArena> arena;    // Every expression and statement node
+    std::string path;                   // File it was read from; its imports are found relative to it
     std::vector<std::unique_ptr<ImportAST>> imports;
     std::vector<std::unique_ptr<ClassAST>> classes;
     std::vector<std::unique_ptr<InterfaceAST>> interfaces;
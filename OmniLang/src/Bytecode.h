@@ -0,0 +1,135 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include "AST.h"
+#include "StdLib.h"
+#include "Resolver.h"
+
+//===----------------------------------------------------------------------===//
+// Instruction Set
+//===----------------------------------------------------------------------===//
+
+// Each instruction is one opcode byte followed by its operands. u16 operands
+// are little-endian; jump targets are absolute offsets into the chunk.
+//
+//   Constant     u16 const         push constants[const]
+//   GetLocal     u16 slot          push slots[slot]
+//   SetLocal     u16 slot          pop into slots[slot]
+//   GetGlobal    u16 global        push globals[global]
+//   Jump         u16 target
+//   JumpIfFalse  u16 target        pop condition
+//   JumpIfTrue   u16 target        pop condition
+//   Call         u16 func u8 argc  call a compiled user function
+//   CallNative   u16 native u8 argc
+//   CallUnknown  u16 name u8 argc  pop args, raise "Unknown function"
+//   CallValue    u16 name u8 argc  callee value sits below the arguments: call it if it
+//                                  is a lambda, otherwise the function called name
+//   Invoke       u16 site u8 argc  receiver sits below the arguments
+//   New          u16 class u8 argc
+//   GetField     u16 site
+//   InitField    u16 site          pop value into self (slot 0) field
+//   SetField     u16 site          pop object, then the value stored into it
+//   UpdateField  u16 site u8 op    like SetField, combining the old value with BinaryOp op
+//   SetIndex                       pop index and container, then the value stored into it
+//   UpdateIndex  u8 op             like SetIndex, combining the old value with BinaryOp op
+//   MakeArray    u16 count
+//   MakeLambda   u16 lambda        pop self and the captured values into a new closure
+//   Concat       u16 count         pop count values, push their text joined
+//   Format       u16 spec          replace the top value with its text under an f-string spec
+//   ForNext      u16 iter u16 index u16 var u16 exit
+//   Try          u16 handler       handler starts with the message pushed
+//
+// The X-macro keeps the enum and the VM's dispatch table in the same order.
+#define OMNI_OPCODES(X) \
+    X(Constant) X(Nil) X(True) X(False) X(Pop) \
+    X(GetLocal) X(SetLocal) X(GetGlobal) \
+    X(Add) X(Sub) X(Mul) X(Div) X(Mod) \
+    X(Equal) X(NotEqual) X(Less) X(Greater) X(LessEqual) X(GreaterEqual) \
+    X(Not) X(Negate) \
+    X(Jump) X(JumpIfFalse) X(JumpIfTrue) \
+    X(Call) X(CallNative) X(CallUnknown) X(CallValue) X(Invoke) X(New) \
+    X(GetField) X(InitField) X(SetField) X(UpdateField) X(Index) X(SetIndex) X(UpdateIndex) X(MakeArray) X(MakeLambda) X(Concat) X(Format) \
+    X(ForNext) X(Try) X(EndTry) X(Throw) X(Return)
+
+enum class OpCode : uint8_t {
+#define OMNI_OPCODE_ENUM(name) name,
+    OMNI_OPCODES(OMNI_OPCODE_ENUM)
+#undef OMNI_OPCODE_ENUM
+};
+
+//===----------------------------------------------------------------------===//
+// Compiled Program
+//===----------------------------------------------------------------------===//
+
+struct Chunk {
+    std::vector<uint8_t> code;
+    std::vector<int> lines;                 // Source line of every code byte
+    std::vector<RuntimeValue> constants;
+};
+
+// Frame layout: slot 0 holds self (null for plain functions), parameters
+// follow from slot 1, then locals. The operand stack sits above the slots.
+struct CompiledFunction {
+    std::string name;
+    int arity = 0;              // Parameters excluding self
+    int numSlots = 1;
+    int maxStack = 0;
+    Chunk chunk;
+};
+
+struct CompiledClass {
+    std::string name;
+    ClassAST* ast = nullptr;                    // null for unknown class names
+    CompiledClass* parent = nullptr;
+    CompiledFunction* fieldInit = nullptr;      // Evaluates this class's own field initializers
+    CompiledFunction* constructor = nullptr;    // Own or inherited
+    std::unordered_map<std::string, CompiledFunction*> methods;  // Own and inherited
+};
+
+// Method call site: receiver type is only known at run time, so keep both
+// the method name and the matching String.* builtin (if any), plus an inline
+// cache of the receiver classes seen here and the method each resolved to.
+struct InvokeSite {
+    std::string methodName;
+    const NativeFunc* stringMethod = nullptr;
+    const NativeFunc* arrayMethod = nullptr;
+    const NativeFunc* mapMethod = nullptr;
+
+    struct CacheEntry {
+        const ClassAST* cls;
+        CompiledFunction* method;
+    };
+    static const int kCacheSize = 4;
+    CacheEntry cache[kCacheSize] = {};
+    int cacheCount = 0;
+};
+
+// Field access site: the field's name and the slot it had in the last
+// instance seen here
+struct FieldSite {
+    Symbol name;
+    FieldCache cache;
+};
+
+// A lambda and its body, compiled as a function of its parameters
+struct CompiledLambda {
+    LambdaExprAST* ast;
+    CompiledFunction* code;
+};
+
+struct CompiledProgram {
+    std::vector<std::unique_ptr<CompiledFunction>> functions;
+    std::unordered_map<std::string, CompiledFunction*> functionIndex;
+    std::vector<std::unique_ptr<CompiledClass>> classes;
+    std::unordered_map<std::string, CompiledClass*> classIndex;
+    std::vector<const NativeFunc*> natives;
+    std::vector<InvokeSite> invokeSites;
+    std::vector<FieldSite> fieldSites;
+    std::vector<CompiledLambda> lambdas;
+    std::vector<const FormatSpec*> formats;            // f-string {value:spec} placeholders
+    GlobalTable globals;
+    CompiledFunction* entry = nullptr;                  // main()
+};
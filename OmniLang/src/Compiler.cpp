@@ -0,0 +1,713 @@
+#include "Compiler.h"
+#include "ModuleRegistry.h"
+
+//===----------------------------------------------------------------------===//
+// Program Layout
+//===----------------------------------------------------------------------===//
+
+std::unique_ptr<CompiledProgram> Compiler::compile(ProgramAST& program) {
+    auto result = std::make_unique<CompiledProgram>();
+    out = result.get();
+
+    // Same registration order as Interpreter::execute: imported names first,
+    // then the program's own classes and functions override them.
+    std::unordered_map<std::string, FunctionAST*> functions;
+    std::unordered_map<std::string, ClassAST*> classes;
+    std::set<std::string> imported;
+    std::vector<ProgramAST*> modules;
+    collectImports(program, imported, modules);
+    for (ProgramAST* module : modules) {
+        for (auto& func : module->functions) {
+            if (func->name != "main") functions[func->name] = func.get();
+        }
+        for (auto& cls : module->classes) {
+            classes[cls->name] = cls.get();
+        }
+    }
+    Resolver resolver(out->globals);
+    resolver.resolve(program);
+    for (auto& cls : program.classes) {
+        classes[cls->name] = cls.get();
+    }
+    for (auto& func : program.functions) {
+        functions[func->name] = func.get();
+    }
+    Resolver::linkClasses(classes);
+
+    // Declare everything first so calls can be resolved while compiling bodies
+    for (auto& [name, func] : functions) {
+        functionIndex[name] = (int)out->functions.size();
+        out->functionIndex[name] = newFunction(name);
+    }
+    std::unordered_map<FunctionAST*, CompiledFunction*> compiledMethods;
+    for (auto& [name, ast] : classes) {
+        CompiledClass* cls = out->classes[classSlot(name)].get();
+        cls->ast = ast;
+        if (!ast->fields.empty()) cls->fieldInit = newFunction(name + ".<fields>");
+        if (ast->constructor) {
+            compiledMethods[ast->constructor.get()] = newFunction(name + ".__init__");
+        }
+        for (auto& method : ast->methods) {
+            compiledMethods[method.get()] = newFunction(name + "." + method->name);
+        }
+    }
+
+    // Method tables share the compiled bodies of inherited methods
+    for (auto& [name, ast] : classes) {
+        CompiledClass* cls = out->classes[classIndex[name]].get();
+        if (ast->parent) cls->parent = out->classes[classIndex[ast->parent->name]].get();
+        if (ast->initializer) cls->constructor = compiledMethods[ast->initializer];
+        for (auto& [methodName, method] : ast->methodTable) {
+            cls->methods[methodName] = compiledMethods[method];
+        }
+    }
+
+    for (auto& [name, func] : functions) {
+        compileFunction(out->functions[functionIndex[name]].get(), func, false);
+    }
+    for (auto& [name, ast] : classes) {
+        CompiledClass* cls = out->classes[classIndex[name]].get();
+        if (cls->fieldInit) compileFieldInit(cls->fieldInit, ast);
+        if (ast->constructor) {
+            compileFunction(compiledMethods[ast->constructor.get()], ast->constructor.get(), true);
+        }
+        for (auto& method : ast->methods) {
+            compileFunction(compiledMethods[method.get()], method.get(), false);
+        }
+    }
+    // Lambdas found in lambda bodies are appended as they are compiled
+    for (size_t i = 0; i < out->lambdas.size(); i++) {
+        compileLambda(out->lambdas[i]);
+    }
+
+    if (!functionIndex.count("main")) {
+        throw OmniException("No main() function found");
+    }
+    out->entry = out->functions[functionIndex["main"]].get();
+    return result;
+}
+
+// The modules `from` imports, each after the modules it imports in turn.
+// `seen` holds their canonical paths, so each is listed once.
+void Compiler::collectImports(const ProgramAST& from, std::set<std::string>& seen, std::vector<ProgramAST*>& modules) {
+    for (auto& imp : from.imports) {
+        std::string path = ModuleRegistry::locate(imp->moduleName, from.path);
+        ProgramAST* module = path.empty() ? nullptr : ModuleRegistry::load(path);
+        if (!module) {
+            throw OmniException("Cannot import: " + imp->moduleName);
+        }
+        if (!seen.insert(path).second) continue;
+        collectImports(*module, seen, modules);
+        modules.push_back(module);
+    }
+}
+
+CompiledFunction* Compiler::newFunction(const std::string& name) {
+    out->functions.push_back(std::make_unique<CompiledFunction>());
+    out->functions.back()->name = name;
+    return out->functions.back().get();
+}
+
+// Index of the class named `name`, creating an empty entry for names that
+// are never defined (`new` on those yields a bare object, like the tree-walker).
+int Compiler::classSlot(const std::string& name) {
+    auto it = classIndex.find(name);
+    if (it != classIndex.end()) return it->second;
+    int idx = (int)out->classes.size();
+    out->classes.push_back(std::make_unique<CompiledClass>());
+    out->classes.back()->name = name;
+    out->classIndex[name] = out->classes.back().get();
+    classIndex[name] = idx;
+    return idx;
+}
+
+void Compiler::compileFunction(CompiledFunction* target, FunctionAST* func, bool isConstructor) {
+    beginFunction(target, func->numSlots);
+    inConstructor = isConstructor;
+    target->arity = func->arity;
+
+    // A function without an explicit return yields the value of its last
+    // top-level statement; constructors always yield the finished object.
+    for (size_t i = 0; i < func->body.size(); i++) {
+        StmtAST* stmt = func->body[i].get();
+        bool last = i + 1 == func->body.size();
+        if (!last || isConstructor || !stmt) {
+            compileStmt(stmt);
+            continue;
+        }
+        if (stmt->kind == StmtKind::Expr) {
+            compileExpr(static_cast<ExprStmtAST*>(stmt)->expr.get());
+            emitOp(OpCode::Return, -1);
+        } else if (stmt->kind == StmtKind::VarDecl) {
+            compileStmt(stmt);
+            compileLoad(static_cast<VarDeclStmtAST*>(stmt)->target);
+            emitOp(OpCode::Return, -1);
+        } else {
+            compileStmt(stmt);
+        }
+    }
+    if (isConstructor) {
+        emitOp(OpCode::GetLocal, 1);
+        emitU16(0);
+    } else {
+        emitOp(OpCode::Nil, 1);
+    }
+    emitOp(OpCode::Return, -1);
+}
+
+void Compiler::compileFieldInit(CompiledFunction* target, ClassAST* cls) {
+    beginFunction(target, 1);
+    for (auto& field : cls->fields) {
+        if (field.initializer) {
+            compileExpr(field.initializer.get());
+        } else {
+            emitOp(OpCode::Nil, 1);
+        }
+        emitOp(OpCode::InitField, -1);
+        emitU16(fieldSite(field.name));
+    }
+    emitOp(OpCode::GetLocal, 1);
+    emitU16(0);
+    emitOp(OpCode::Return, -1);
+}
+
+void Compiler::compileLambda(const CompiledLambda& lambda) {
+    beginFunction(lambda.code, lambda.ast->numSlots);
+    lambda.code->arity = (int)lambda.ast->params.size();
+    currentLine = lambda.ast->line;
+    compileExpr(lambda.ast->body.get());
+    emitOp(OpCode::Return, -1);
+}
+
+void Compiler::beginFunction(CompiledFunction* target, int numSlots) {
+    fn = target;
+    fn->numSlots = numSlots;
+    stackDepth = 0;
+    tryDepth = 0;
+    inConstructor = false;
+    loops.clear();
+}
+
+//===----------------------------------------------------------------------===//
+// Emission
+//===----------------------------------------------------------------------===//
+
+void Compiler::emitOp(OpCode op, int stackEffect) {
+    emitByte((uint8_t)op);
+    stackDepth += stackEffect;
+    if (stackDepth > fn->maxStack) fn->maxStack = stackDepth;
+}
+
+void Compiler::emitByte(uint8_t byte) {
+    fn->chunk.code.push_back(byte);
+    fn->chunk.lines.push_back(currentLine);
+}
+
+void Compiler::emitU16(int value) {
+    if (value < 0 || value > 0xFFFF) {
+        throw OmniException("Bytecode operand out of range in " + fn->name, currentLine);
+    }
+    emitByte((uint8_t)(value & 0xFF));
+    emitByte((uint8_t)((value >> 8) & 0xFF));
+}
+
+size_t Compiler::emitJump(OpCode op) {
+    emitOp(op, op == OpCode::Jump ? 0 : -1);
+    size_t operand = here();
+    emitU16(0);
+    return operand;
+}
+
+void Compiler::patchJump(size_t operand, size_t target) {
+    if (target > 0xFFFF) throw OmniException("Function too large: " + fn->name, currentLine);
+    fn->chunk.code[operand] = (uint8_t)(target & 0xFF);
+    fn->chunk.code[operand + 1] = (uint8_t)((target >> 8) & 0xFF);
+}
+
+int Compiler::addConstant(const RuntimeValue& value) {
+    fn->chunk.constants.push_back(value);
+    return (int)fn->chunk.constants.size() - 1;
+}
+
+int Compiler::nameConstant(const std::string& name) {
+    auto& constants = fn->chunk.constants;
+    for (size_t i = 0; i < constants.size(); i++) {
+        if (constants[i].type == ValueType::String && constants[i].str() == name) return (int)i;
+    }
+    return addConstant(RuntimeValue::literal(name));
+}
+
+int Compiler::fieldSite(const std::string& name) {
+    out->fieldSites.push_back({Symbol(name), {}});
+    return (int)out->fieldSites.size() - 1;
+}
+
+int Compiler::argCount(size_t count) {
+    if (count > 0xFF) throw OmniException("Too many arguments", currentLine);
+    return (int)count;
+}
+
+//===----------------------------------------------------------------------===//
+// Statements
+//===----------------------------------------------------------------------===//
+
+void Compiler::compileBlock(std::vector<StmtPtr>& body) {
+    for (auto& stmt : body) {
+        compileStmt(stmt.get());
+    }
+}
+
+void Compiler::compileStmt(StmtAST* stmt) {
+    if (!stmt) return;
+    if (stmt->line > 0) currentLine = stmt->line;
+
+    switch (stmt->kind) {
+    case StmtKind::Expr:
+        compileExpr(static_cast<ExprStmtAST*>(stmt)->expr.get());
+        emitOp(OpCode::Pop, -1);
+        return;
+
+    case StmtKind::VarDecl: {
+        auto* varDecl = static_cast<VarDeclStmtAST*>(stmt);
+        if (varDecl->initializer) {
+            compileExpr(varDecl->initializer.get());
+        } else {
+            emitOp(OpCode::Nil, 1);
+        }
+        compileStore(varDecl->target);
+        return;
+    }
+
+    case StmtKind::Assign: {
+        auto* assign = static_cast<AssignStmtAST*>(stmt);
+        compileExpr(assign->value.get());
+        if (assign->target->kind == ExprKind::MemberAccess) {
+            auto* member = static_cast<MemberAccessExprAST*>(assign->target.get());
+            compileExpr(member->object.get());
+            emitOp(assign->compound ? OpCode::UpdateField : OpCode::SetField, -2);
+            emitU16(fieldSite(member->memberName));
+        } else {
+            auto* idx = static_cast<IndexExprAST*>(assign->target.get());
+            compileExpr(idx->array.get());
+            compileExpr(idx->index.get());
+            emitOp(assign->compound ? OpCode::UpdateIndex : OpCode::SetIndex, -3);
+        }
+        if (assign->compound) emitByte((uint8_t)assign->op);
+        return;
+    }
+
+    case StmtKind::Return: {
+        auto* retStmt = static_cast<ReturnStmtAST*>(stmt);
+        if (retStmt->value) {
+            compileExpr(retStmt->value.get());
+        } else {
+            emitOp(OpCode::Nil, 1);
+        }
+        if (inConstructor) {
+            emitOp(OpCode::Pop, -1);
+            emitOp(OpCode::GetLocal, 1);
+            emitU16(0);
+        }
+        emitOp(OpCode::Return, -1);
+        return;
+    }
+
+    case StmtKind::If: {
+        auto* ifStmt = static_cast<IfStmtAST*>(stmt);
+        compileExpr(ifStmt->condition.get());
+        size_t elseJump = emitJump(OpCode::JumpIfFalse);
+        compileBlock(ifStmt->thenBody);
+        if (ifStmt->elseBody.empty()) {
+            patchJump(elseJump, here());
+            return;
+        }
+        size_t endJump = emitJump(OpCode::Jump);
+        patchJump(elseJump, here());
+        compileBlock(ifStmt->elseBody);
+        patchJump(endJump, here());
+        return;
+    }
+
+    case StmtKind::While: {
+        auto* whileStmt = static_cast<WhileStmtAST*>(stmt);
+        size_t loopStart = here();
+        compileExpr(whileStmt->condition.get());
+        size_t exitJump = emitJump(OpCode::JumpIfFalse);
+
+        loops.push_back({loopStart, {}, tryDepth});
+        compileBlock(whileStmt->body);
+        size_t back = emitJump(OpCode::Jump);
+        patchJump(back, loopStart);
+
+        patchJump(exitJump, here());
+        for (size_t patch : loops.back().breakPatches) patchJump(patch, here());
+        loops.pop_back();
+        return;
+    }
+
+    case StmtKind::For: {
+        auto* forStmt = static_cast<ForStmtAST*>(stmt);
+        if (!forStmt->iterInPlace) {
+            compileExpr(forStmt->iterable.get());
+            emitOp(OpCode::SetLocal, -1);
+            emitU16(forStmt->iterSlot);
+        }
+        emitOp(OpCode::Constant, 1);
+        emitU16(addConstant(RuntimeValue(0LL)));
+        emitOp(OpCode::SetLocal, -1);
+        emitU16(forStmt->indexSlot);
+
+        size_t loopStart = here();
+        emitOp(OpCode::ForNext, 0);
+        emitU16(forStmt->iterSlot);
+        emitU16(forStmt->indexSlot);
+        emitU16(forStmt->var.index);
+        size_t exitOperand = here();
+        emitU16(0);
+
+        loops.push_back({loopStart, {}, tryDepth});
+        compileBlock(forStmt->body);
+        size_t back = emitJump(OpCode::Jump);
+        patchJump(back, loopStart);
+
+        patchJump(exitOperand, here());
+        for (size_t patch : loops.back().breakPatches) patchJump(patch, here());
+        loops.pop_back();
+        return;
+    }
+
+    case StmtKind::TryCatch: {
+        auto* tryStmt = static_cast<TryCatchStmtAST*>(stmt);
+        size_t handlerOperand = emitJump(OpCode::Try);
+        tryDepth++;
+        compileBlock(tryStmt->tryBody);
+        tryDepth--;
+        emitOp(OpCode::EndTry, 0);
+        size_t finallyJump = emitJump(OpCode::Jump);
+
+        // Handler entry: the VM pushes the exception message
+        patchJump(handlerOperand, here());
+        stackDepth++;
+        if (stackDepth > fn->maxStack) fn->maxStack = stackDepth;
+        compileStore(tryStmt->exceptionRef);
+        compileBlock(tryStmt->catchBody);
+
+        patchJump(finallyJump, here());
+        if (!tryStmt->finallyBody.empty()) {
+            compileBlock(tryStmt->finallyBody);
+        }
+        return;
+    }
+
+    case StmtKind::Throw:
+        compileExpr(static_cast<ThrowStmtAST*>(stmt)->exception.get());
+        emitOp(OpCode::Throw, -1);
+        return;
+
+    case StmtKind::Break:
+        compileLoopExit(true);
+        return;
+
+    case StmtKind::Continue:
+        compileLoopExit(false);
+        return;
+    }
+}
+
+void Compiler::compileLoopExit(bool isBreak) {
+    if (loops.empty()) {
+        throw OmniException(std::string(isBreak ? "'break'" : "'continue'") + " outside of a loop", currentLine);
+    }
+    LoopContext& loop = loops.back();
+    for (int i = loop.tryDepth; i < tryDepth; i++) {
+        emitOp(OpCode::EndTry, 0);
+    }
+    size_t jump = emitJump(OpCode::Jump);
+    if (isBreak) {
+        loop.breakPatches.push_back(jump);
+    } else {
+        patchJump(jump, loop.continueTarget);
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Expressions
+//===----------------------------------------------------------------------===//
+
+void Compiler::compileExpr(ExprAST* expr) {
+    if (!expr) {
+        emitOp(OpCode::Nil, 1);
+        return;
+    }
+    if (expr->line > 0) currentLine = expr->line;
+
+    switch (expr->kind) {
+    case ExprKind::Number: {
+        auto* num = static_cast<NumberExprAST*>(expr);
+        RuntimeValue value = num->isInt ? RuntimeValue(num->intValue) : RuntimeValue(num->value);
+        emitOp(OpCode::Constant, 1);
+        emitU16(addConstant(value));
+        return;
+    }
+
+    case ExprKind::String:
+        emitOp(OpCode::Constant, 1);
+        emitU16(addConstant(RuntimeValue::literal(static_cast<StringExprAST*>(expr)->symbol)));
+        return;
+
+    case ExprKind::FString:
+        compileFString(static_cast<FStringExprAST*>(expr));
+        return;
+
+    case ExprKind::Variable: {
+        auto* var = static_cast<VariableExprAST*>(expr);
+        if (var->ref.kind != VarRef::Unresolved) {
+            compileLoad(var->ref);
+            return;
+        }
+        // Only literal names are left unresolved
+        if (var->name == "true") emitOp(OpCode::True, 1);
+        else if (var->name == "false") emitOp(OpCode::False, 1);
+        else emitOp(OpCode::Nil, 1);
+        return;
+    }
+
+    case ExprKind::Self:
+        emitOp(OpCode::GetLocal, 1);
+        emitU16(0);
+        return;
+
+    case ExprKind::Binary:
+        compileBinary(static_cast<BinaryExprAST*>(expr));
+        return;
+
+    case ExprKind::Unary: {
+        auto* unary = static_cast<UnaryExprAST*>(expr);
+        compileExpr(unary->operand.get());
+        emitOp(unary->op == UnaryOp::Not ? OpCode::Not : OpCode::Negate, 0);
+        return;
+    }
+
+    case ExprKind::Call: {
+        auto* call = static_cast<CallExprAST*>(expr);
+        if (call->closure.kind != VarRef::Unresolved) {
+            compileLoad(call->closure);
+            compileArgs(call->args);
+            int argc = argCount(call->args.size());
+            emitOp(OpCode::CallValue, -argc);
+            emitU16(nameConstant(call->callee));
+            emitByte((uint8_t)argc);
+            return;
+        }
+        compileArgs(call->args);
+        int argc = argCount(call->args.size());
+        if (call->native) {
+            emitOp(OpCode::CallNative, 1 - argc);
+            emitU16((int)out->natives.size());
+            out->natives.push_back(call->native);
+        } else if (functionIndex.count(call->callee)) {
+            emitOp(OpCode::Call, 1 - argc);
+            emitU16(functionIndex[call->callee]);
+        } else {
+            emitOp(OpCode::CallUnknown, 1 - argc);
+            emitU16(nameConstant(call->callee));
+        }
+        emitByte((uint8_t)argc);
+        return;
+    }
+
+    case ExprKind::New: {
+        auto* newExpr = static_cast<NewExprAST*>(expr);
+        int idx = classSlot(newExpr->className);
+        ClassAST* ast = out->classes[idx]->ast;
+        // Constructor arguments are only evaluated when there is a constructor
+        int argc = 0;
+        if (ast && ast->initializer) {
+            compileArgs(newExpr->args);
+            argc = argCount(newExpr->args.size());
+        }
+        emitOp(OpCode::New, 1 - argc);
+        emitU16(idx);
+        emitByte((uint8_t)argc);
+        return;
+    }
+
+    case ExprKind::MemberAccess: {
+        auto* member = static_cast<MemberAccessExprAST*>(expr);
+        compileExpr(member->object.get());
+        emitOp(OpCode::GetField, 0);
+        emitU16(fieldSite(member->memberName));
+        return;
+    }
+
+    case ExprKind::MethodCall: {
+        auto* methodCall = static_cast<MethodCallExprAST*>(expr);
+        // Module call (Math.sqrt, File.read, ...) resolved statically
+        if (methodCall->moduleFunc) {
+            compileArgs(methodCall->args);
+            if (methodCall->reusedVar.kind != VarRef::Unresolved) {
+                emitOp(OpCode::Nil, 1);
+                compileStore(methodCall->reusedVar);
+            }
+            if (auto* field = methodCall->reusedField) {
+                emitOp(OpCode::Nil, 1);
+                compileExpr(field->object.get());
+                emitOp(OpCode::SetField, -2);
+                emitU16(fieldSite(field->memberName));
+            }
+            int argc = argCount(methodCall->args.size());
+            emitOp(OpCode::CallNative, 1 - argc);
+            emitU16((int)out->natives.size());
+            out->natives.push_back(methodCall->moduleFunc);
+            emitByte((uint8_t)argc);
+            return;
+        }
+
+        compileExpr(methodCall->object.get());
+        compileArgs(methodCall->args);
+        int argc = argCount(methodCall->args.size());
+
+        InvokeSite site;
+        site.methodName = methodCall->methodName;
+        site.stringMethod = methodCall->stringMethod;
+        site.arrayMethod = methodCall->arrayMethod;
+        site.mapMethod = methodCall->mapMethod;
+
+        emitOp(OpCode::Invoke, -argc);
+        emitU16((int)out->invokeSites.size());
+        out->invokeSites.push_back(site);
+        emitByte((uint8_t)argc);
+        return;
+    }
+
+    case ExprKind::Array: {
+        auto* arr = static_cast<ArrayExprAST*>(expr);
+        for (auto& elem : arr->elements) {
+            compileExpr(elem.get());
+        }
+        emitOp(OpCode::MakeArray, 1 - (int)arr->elements.size());
+        emitU16((int)arr->elements.size());
+        return;
+    }
+
+    case ExprKind::Index: {
+        auto* idx = static_cast<IndexExprAST*>(expr);
+        compileExpr(idx->array.get());
+        compileExpr(idx->index.get());
+        emitOp(OpCode::Index, -1);
+        return;
+    }
+
+    case ExprKind::Concat: {
+        auto* concat = static_cast<ConcatExprAST*>(expr);
+        for (auto& part : concat->parts) {
+            compileExpr(part.get());
+        }
+        if (concat->reusedVar.kind != VarRef::Unresolved) {
+            emitOp(OpCode::Nil, 1);
+            compileStore(concat->reusedVar);
+        }
+        emitOp(OpCode::Concat, 1 - (int)concat->parts.size());
+        emitU16((int)concat->parts.size());
+        return;
+    }
+
+    case ExprKind::Lambda: {
+        auto* lambda = static_cast<LambdaExprAST*>(expr);
+        emitOp(OpCode::GetLocal, 1);
+        emitU16(0);
+        for (auto& captured : lambda->captures) {
+            compileLoad(captured);
+        }
+        emitOp(OpCode::MakeLambda, -(int)lambda->captures.size());
+        emitU16((int)out->lambdas.size());
+        out->lambdas.push_back({lambda, newFunction("<lambda>")});
+        return;
+    }
+    }
+}
+
+void Compiler::compileArgs(std::vector<ExprPtr>& args) {
+    for (auto& arg : args) {
+        compileExpr(arg.get());
+    }
+}
+
+void Compiler::compileLoad(const VarRef& ref) {
+    emitOp(ref.kind == VarRef::Local ? OpCode::GetLocal : OpCode::GetGlobal, 1);
+    emitU16(ref.index);
+}
+
+// Assignments always target locals: only REPL input, which the VM does not
+// run, assigns globals.
+void Compiler::compileStore(const VarRef& ref) {
+    emitOp(OpCode::SetLocal, -1);
+    emitU16(ref.index);
+}
+
+// Each {expr} is evaluated in order, {expr:spec} followed by a Format, and
+// the pieces are joined by a single Concat.
+void Compiler::compileFString(FStringExprAST* fstr) {
+    int parts = 0;
+    for (auto& part : fstr->parts) {
+        if (part.expr) {
+            compileExpr(part.expr.get());
+            if (part.spec) {
+                emitOp(OpCode::Format, 0);
+                emitU16((int)out->formats.size());
+                out->formats.push_back(part.spec.get());
+            }
+        } else {
+            emitOp(OpCode::Constant, 1);
+            emitU16(addConstant(RuntimeValue(part.text)));
+        }
+        parts++;
+    }
+    if (parts == 0) {
+        emitOp(OpCode::Constant, 1);
+        emitU16(addConstant(RuntimeValue(std::string())));
+        parts++;
+    }
+    emitOp(OpCode::Concat, 1 - parts);
+    emitU16(parts);
+}
+
+void Compiler::compileBinary(BinaryExprAST* binary) {
+    if (binary->op == BinaryOp::And || binary->op == BinaryOp::Or) {
+        compileLogical(binary);
+        return;
+    }
+    compileExpr(binary->lhs.get());
+    compileExpr(binary->rhs.get());
+    if (binary->reusedVar.kind != VarRef::Unresolved) {
+        emitOp(OpCode::Nil, 1);
+        compileStore(binary->reusedVar);
+    }
+
+    static const OpCode ops[] = {
+        OpCode::Add, OpCode::Sub, OpCode::Mul, OpCode::Div, OpCode::Mod,
+        OpCode::Equal, OpCode::NotEqual, OpCode::Less, OpCode::Greater,
+        OpCode::LessEqual, OpCode::GreaterEqual,
+    };
+    emitOp(ops[(int)binary->op], -1);
+}
+
+// a && b  =>  a; JumpIfFalse F; b; JumpIfFalse F; True; Jump End; F: False
+// a || b  =>  the same with JumpIfTrue and the constants swapped
+void Compiler::compileLogical(BinaryExprAST* binary) {
+    bool isAnd = binary->op == BinaryOp::And;
+    OpCode test = isAnd ? OpCode::JumpIfFalse : OpCode::JumpIfTrue;
+
+    compileExpr(binary->lhs.get());
+    size_t first = emitJump(test);
+    compileExpr(binary->rhs.get());
+    size_t second = emitJump(test);
+    emitOp(isAnd ? OpCode::True : OpCode::False, 1);
+    size_t end = emitJump(OpCode::Jump);
+
+    stackDepth--;   // The short-circuit path arrives without the result
+    patchJump(first, here());
+    patchJump(second, here());
+    emitOp(isAnd ? OpCode::False : OpCode::True, 1);
+    patchJump(end, here());
+}
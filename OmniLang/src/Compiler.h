@@ -0,0 +1,68 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include "AST.h"
+#include "Bytecode.h"
+
+// Lowers a parsed ProgramAST (plus its imports) into bytecode for the VM.
+// Variable slots and frame sizes come from the Resolver.
+class Compiler {
+public:
+    std::unique_ptr<CompiledProgram> compile(ProgramAST& program);
+
+private:
+    struct LoopContext {
+        size_t continueTarget = 0;
+        std::vector<size_t> breakPatches;
+        int tryDepth = 0;
+    };
+
+    CompiledProgram* out = nullptr;
+    std::unordered_map<std::string, int> functionIndex;
+    std::unordered_map<std::string, int> classIndex;
+
+    // Per-function state
+    CompiledFunction* fn = nullptr;
+    int stackDepth = 0;
+    int tryDepth = 0;
+    int currentLine = 0;
+    bool inConstructor = false;
+    std::vector<LoopContext> loops;
+
+    // Program layout
+    void collectImports(const ProgramAST& from, std::set<std::string>& seen, std::vector<ProgramAST*>& modules);
+    CompiledFunction* newFunction(const std::string& name);
+    int classSlot(const std::string& name);
+    void compileFunction(CompiledFunction* target, FunctionAST* func, bool isConstructor);
+    void compileFieldInit(CompiledFunction* target, ClassAST* cls);
+    void compileLambda(const CompiledLambda& lambda);
+
+    void beginFunction(CompiledFunction* target, int numSlots);
+
+    // Emission
+    void emitOp(OpCode op, int stackEffect);
+    void emitByte(uint8_t byte);
+    void emitU16(int value);
+    size_t emitJump(OpCode op);
+    void patchJump(size_t operand, size_t target);
+    size_t here() const { return fn->chunk.code.size(); }
+    int addConstant(const RuntimeValue& value);
+    int nameConstant(const std::string& name);
+    int fieldSite(const std::string& name);     // New FieldSite for one field instruction
+    int argCount(size_t count);
+
+    // Statements & expressions
+    void compileBlock(std::vector<StmtPtr>& body);
+    void compileStmt(StmtAST* stmt);
+    void compileLoopExit(bool isBreak);
+    void compileExpr(ExprAST* expr);
+    void compileLoad(const VarRef& ref);
+    void compileStore(const VarRef& ref);
+    void compileArgs(std::vector<ExprPtr>& args);
+    void compileFString(FStringExprAST* fstr);
+    void compileBinary(BinaryExprAST* binary);
+    void compileLogical(BinaryExprAST* binary);
+};
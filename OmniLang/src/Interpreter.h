@@ -6,47 +6,50 @@
 #include <set>
 #include <sstream>
 #include <fstream>
+#include <utility>
 #include "AST.h"
 #include "StdLib.h"
-#include "Lexer.h"
-#include "Parser.h"
+#include "Operators.h"
+#include "Resolver.h"
+#include "ModuleRegistry.h"
 
-// Exception types for control flow
-struct ReturnException {
-    RuntimeValue value;
-    ReturnException(RuntimeValue v) : value(v) {}
-};
+// How control leaves a statement. Return/break/continue travel back up
+// through executeStmt as values; C++ exceptions are only used for
+// OmniException errors.
+struct Completion {
+    enum Status : unsigned char { Normal, Return, Break, Continue };
+    Status status = Normal;
+    RuntimeValue value;     // Statement value, or the returned value
 
-struct OmniException : public std::exception {
-    std::string message;
-    int line;
-    OmniException(const std::string& msg, int l = 0) : message(msg), line(l) {}
-    const char* what() const noexcept override { return message.c_str(); }
+    Completion() = default;
+    Completion(Status s, RuntimeValue v = RuntimeValue()) : status(s), value(std::move(v)) {}
 };
 
-struct BreakException {};
-struct ContinueException {};
-
-class Interpreter {
+class Interpreter : public LambdaCaller {
 public:
     RuntimeValue execute(ProgramAST& program) {
+        LambdaCaller::Scope caller(this);
+        
         // Process imports first
         for (auto& imp : program.imports) {
-            processImport(imp->moduleName);
+            processImport(imp->moduleName, program.path);
         }
         
+        resolve(program);
+        
         // Register classes
         for (auto& cls : program.classes) {
             classes[cls->name] = cls.get();
         }
+        Resolver::linkClasses(classes);
         
         // Find and run main()
         for (auto& func : program.functions) {
-            functions[func->name] = func.get();
+            registerFunction(func.get());
         }
         
         if (functions.count("main")) {
-            return executeFunction(functions["main"], {});
+            return executeFunction(functions["main"], RuntimeValue(), {});
         }
         
         throw OmniException("No main() function found");
@@ -54,411 +57,455 @@ public:
     
     // REPL mode: register functions and call __repl__ directly
     RuntimeValue executeREPL(ProgramAST& program) {
+        LambdaCaller::Scope caller(this);
         // Register functions (don't require main)
+        resolve(program);
         for (auto& func : program.functions) {
-            functions[func->name] = func.get();
+            registerFunction(func.get());
         }
         
         // Call __repl__ if it exists
         if (functions.count("__repl__")) {
-            return executeFunction(functions["__repl__"], {});
+            return executeFunction(functions["__repl__"], RuntimeValue(), {});
         }
         
         return RuntimeValue(); // Return nil if no __repl__
     }
     
-    // REPL mode with persistent variables
-    RuntimeValue executeREPLWithPersistence(ProgramAST& program) {
+    // REPL mode with persistent variables. Lambdas made by the line share
+    // ownership of it, so it lives as long as the last of them.
+    RuntimeValue executeREPLWithPersistence(const std::shared_ptr<ProgramAST>& program) {
+        LambdaCaller::Scope caller(this);
+        OwnerGuard owner{*this, std::exchange(codeOwner, program)};
         // Register functions
-        for (auto& func : program.functions) {
-            functions[func->name] = func.get();
+        for (auto& func : program->functions) {
+            registerFunction(func.get());
         }
         
-        // Call __repl__ and preserve variables
+        // Call __repl__; its top-level variables are globals, so they
+        // persist into the next line
         if (functions.count("__repl__")) {
             FunctionAST* replFunc = functions["__repl__"];
-            pushScope();
-            
-            // Copy globals to current scope so they're accessible
-            for (auto& [name, val] : globals) {
-                scopes.back()[name] = val;
-            }
-            
-            RuntimeValue result;
-            try {
-                for (auto& stmt : replFunc->body) {
-                    result = executeStmt(stmt.get());
-                }
-            } catch (const RuntimeValue& returnVal) {
-                result = returnVal;
-            }
-            
-            // Copy variables back to globals for persistence
-            if (!scopes.empty()) {
-                for (auto& [name, val] : scopes.back()) {
-                    if (name != "__repl__") {  // Don't save the function itself
-                        globals[name] = val;
-                    }
-                }
-            }
-            
-            popScope();
-            return result;
+            Resolver resolver(globalTable);
+            resolver.resolveScript(replFunc);
+            globals.resize(globalTable.size());
+            return executeFunction(replFunc, RuntimeValue(), {});
         }
         
         return RuntimeValue();
     }
     
-    void processImport(const std::string& moduleName) {
-        // Avoid double imports
-        if (importedModules.count(moduleName)) return;
-        importedModules.insert(moduleName);
-        
-        // Read file
-        std::ifstream file(moduleName);
-        if (!file.is_open()) {
+    // Call sites cache the function a name resolved to, so any change to
+    // the registry moves it to a new epoch. The counter is process-wide so
+    // two interpreters never hand out the same epoch.
+    void registerFunction(FunctionAST* func) {
+        static unsigned epochCounter = 0;
+        functions[func->name] = func;
+        functionsEpoch = ++epochCounter;
+    }
+    
+    // Registers what the module defines, after the modules it imports
+    void processImport(const std::string& moduleName, const std::string& fromFile) {
+        std::string path = ModuleRegistry::locate(moduleName, fromFile);
+        ProgramAST* module = path.empty() ? nullptr : ModuleRegistry::load(path);
+        if (!module) {
             throw OmniException("Cannot import: " + moduleName);
         }
-        std::stringstream buf;
-        buf << file.rdbuf();
-        std::string source = buf.str();
         
-        // Lex and parse the imported module
-        Lexer lexer(source);
-        std::vector<Token> tokens = lexer.tokenize();
-        Parser parser(tokens);
-        auto importedProgram = parser.parse();
+        // Avoid double imports
+        if (!importedModules.insert(path).second) return;
+        for (auto& imp : module->imports) {
+            processImport(imp->moduleName, path);
+        }
         
         // Register imported functions and classes
-        for (auto& func : importedProgram->functions) {
+        for (auto& func : module->functions) {
             if (func->name != "main") { // Don't import main()
-                functions[func->name] = func.get();
-                ownedFunctions.push_back(std::move(func));
+                registerFunction(func.get());
             }
         }
-        for (auto& cls : importedProgram->classes) {
+        for (auto& cls : module->classes) {
             classes[cls->name] = cls.get();
-            ownedClasses.push_back(std::move(cls));
         }
     }
 
 private:
     int currentLine = 0;
-    std::unordered_map<std::string, RuntimeValue> globals;
+    GlobalTable globalTable;
+    std::vector<RuntimeValue> globals;  // Indexed like globalTable
     std::unordered_map<std::string, FunctionAST*> functions;
+    unsigned functionsEpoch = 0;        // Changes whenever `functions` does
     std::unordered_map<std::string, ClassAST*> classes;
     
-    // Import tracking
+    // Canonical paths of imported modules; ModuleRegistry owns their code
     std::set<std::string> importedModules;
-    std::vector<std::unique_ptr<FunctionAST>> ownedFunctions;
-    std::vector<std::unique_ptr<ClassAST>> ownedClasses;
     
-    // Current scope variables
-    std::vector<std::unordered_map<std::string, RuntimeValue>> scopes;
+    // What owns the AST of the running code, for lambdas made from it:
+    // the REPL line, or null for programs and modules, which outlive them
+    std::shared_ptr<const void> codeOwner;
+    
+    // Frames of all active calls, innermost last. Slot indices come from
+    // the Resolver, so a variable access is a single array index.
+    std::vector<RuntimeValue> stack;
+    size_t frameBase = 0;
     
-    void pushScope() {
-        scopes.push_back({});
+    void resolve(ProgramAST& program) {
+        Resolver resolver(globalTable);
+        resolver.resolve(program);
+        globals.resize(globalTable.size());
     }
     
-    void popScope() {
-        if (!scopes.empty()) scopes.pop_back();
+    RuntimeValue& slot(int index) {
+        return stack[frameBase + index];
     }
     
-    void setVar(const std::string& name, const RuntimeValue& val) {
-        // First check if variable exists in any scope (update existing)
-        for (int i = scopes.size() - 1; i >= 0; i--) {
-            if (scopes[i].count(name)) {
-                scopes[i][name] = val;
-                return;
-            }
-        }
-        // Check globals
-        if (globals.count(name)) {
-            globals[name] = val;
-            return;
-        }
-        // Create new variable in current scope
-        if (!scopes.empty()) {
-            scopes.back()[name] = val;
-        } else {
-            globals[name] = val;
-        }
+    RuntimeValue& variable(const VarRef& ref) {
+        return ref.kind == VarRef::Local ? slot(ref.index) : globals[ref.index];
     }
     
-    RuntimeValue getVar(const std::string& name) {
-        // Search from innermost scope outward
-        for (int i = scopes.size() - 1; i >= 0; i--) {
-            if (scopes[i].count(name)) return scopes[i][name];
-        }
-        if (globals.count(name)) return globals[name];
-        return RuntimeValue();  // undefined
+    RuntimeValue getVar(const VariableExprAST* var) {
+        switch (var->ref.kind) {
+        case VarRef::Local:  return slot(var->ref.index);
+        case VarRef::Global: return globals[var->ref.index];
+        case VarRef::Unresolved: break;
+        }
+        // Only literal names are left unresolved
+        if (var->name == "true") return RuntimeValue(true);
+        if (var->name == "false") return RuntimeValue(false);
+        return RuntimeValue();
     }
     
-    bool hasVar(const std::string& name) {
-        for (int i = scopes.size() - 1; i >= 0; i--) {
-            if (scopes[i].count(name)) return true;
-        }
-        return globals.count(name) > 0;
+    void setVar(const VarRef& ref, const RuntimeValue& val) {
+        variable(ref) = val;
     }
     
-    RuntimeValue executeFunction(FunctionAST* func, const std::vector<RuntimeValue>& args) {
-        pushScope();
-        
-        // Bind arguments
-        for (size_t i = 0; i < func->args.size() && i < args.size(); i++) {
-            if (func->args[i].name != "self") {
-                setVar(func->args[i].name, args[i]);
-            }
-        }
-        
+    // Pops the callee's frame however the call ends
+    struct FrameGuard {
+        Interpreter& interp;
+        size_t savedBase;
+        size_t base;
+        ~FrameGuard() {
+            interp.stack.resize(base);
+            interp.frameBase = savedBase;
+        }
+    };
+    
+    struct OwnerGuard {
+        Interpreter& interp;
+        std::shared_ptr<const void> saved;
+        ~OwnerGuard() { interp.codeOwner = std::move(saved); }
+    };
+    
+    // Constructors yield the finished self instead of a return value
+    RuntimeValue executeFunction(FunctionAST* func, const RuntimeValue& self, const std::vector<RuntimeValue>& args,
+                                 bool isConstructor = false) {
+        Heap::safePoint();
+        size_t base = stack.size();
+        stack.resize(base + func->numSlots);
+        FrameGuard guard{*this, frameBase, base};
+        frameBase = base;
+        
+        // Bind self and arguments
+        slot(0) = self;
+        for (int i = 0; i < func->arity && i < (int)args.size(); i++) {
+            slot(1 + i) = args[i];
+        }
+        
+        // Without a return, the value of the last statement is the result
         RuntimeValue result;
-        try {
-            for (auto& stmt : func->body) {
-                result = executeStmt(stmt.get());
-            }
-        } catch (const RuntimeValue& returnVal) {
-            result = returnVal;
+        for (auto& stmt : func->body) {
+            Completion c = executeStmt(stmt.get());
+            result = std::move(c.value);
+            if (c.status == Completion::Return) break;
         }
-        
-        popScope();
-        return result;
+        return isConstructor ? slot(0) : result;
+    }
+    
+    // A lambda's frame starts as a copy of the values it captured, with the
+    // arguments placed after self
+    RuntimeValue callLambda(const RuntimeValue& fn, RuntimeValue* args, int argc) override {
+        const LambdaCell* closure = fn.lambda();
+        if (!closure) throw OmniException("Not a function: " + fn.toString(), currentLine);
+        LambdaExprAST* lambda = closure->ast;
+        if (argc != (int)lambda->params.size()) {
+            throw OmniException("Lambda expects " + std::to_string(lambda->params.size()) + " arguments, got " +
+                                std::to_string(argc), currentLine);
+        }
+        Heap::safePoint();
+        size_t base = stack.size();
+        stack.resize(base + lambda->numSlots);
+        FrameGuard guard{*this, frameBase, base};
+        frameBase = base;
+        OwnerGuard owner{*this, std::exchange(codeOwner, closure->owner)};
+        
+        slot(0) = closure->env[0];
+        for (int i = 0; i < argc; i++) {
+            slot(1 + i) = std::move(args[i]);
+        }
+        for (size_t i = 1; i < closure->env.size(); i++) {
+            slot(argc + (int)i) = closure->env[i];
+        }
+        return evalExpr(lambda->body.get());
+    }
+    
+    // Runs statements until one completes abruptly
+    Completion executeBlock(std::vector<StmtPtr>& body) {
+        for (auto& s : body) {
+            Completion c = executeStmt(s.get());
+            if (c.status != Completion::Normal) return c;
+        }
+        return Completion();
     }
     
-    RuntimeValue executeStmt(StmtAST* stmt) {
-        if (!stmt) return RuntimeValue();
+    Completion executeStmt(StmtAST* stmt) {
+        if (!stmt) return Completion();
         if (stmt->line > 0) currentLine = stmt->line;
 
-        if (auto* exprStmt = dynamic_cast<ExprStmtAST*>(stmt)) {
-            return evalExpr(exprStmt->expr.get());
+        switch (stmt->kind) {
+        case StmtKind::Expr: {
+            auto* exprStmt = static_cast<ExprStmtAST*>(stmt);
+            return Completion(Completion::Normal, evalExpr(exprStmt->expr.get()));
         }
         
-        if (auto* varDecl = dynamic_cast<VarDeclStmtAST*>(stmt)) {
+        case StmtKind::VarDecl: {
+            auto* varDecl = static_cast<VarDeclStmtAST*>(stmt);
             RuntimeValue val;
             if (varDecl->initializer) {
                 val = evalExpr(varDecl->initializer.get());
             }
-            setVar(varDecl->name, val);
-            return val;
+            setVar(varDecl->target, val);
+            return Completion(Completion::Normal, std::move(val));
+        }
+        
+        // Objects and arrays are shared, so the change is seen by every reference
+        case StmtKind::Assign: {
+            auto* assign = static_cast<AssignStmtAST*>(stmt);
+            RuntimeValue value = evalExpr(assign->value.get());
+            RuntimeValue* target;
+            RuntimeValue container;
+            if (assign->target->kind == ExprKind::MemberAccess) {
+                auto* member = static_cast<MemberAccessExprAST*>(assign->target.get());
+                container = evalExpr(member->object.get());
+                if (container.type != ValueType::Object) {
+                    throw OmniException("Cannot set field '" + member->memberName + "' on a non-object value", currentLine);
+                }
+                target = &container.field(member->member, member->cache);
+            } else {
+                auto* idx = static_cast<IndexExprAST*>(assign->target.get());
+                container = evalExpr(idx->array.get());
+                RuntimeValue index = evalExpr(idx->index.get());
+                target = &Operators::element(container, index, currentLine);
+            }
+            *target = assign->compound ? Operators::binary(assign->op, *target, value, currentLine) : std::move(value);
+            return Completion();
         }
         
-        if (auto* retStmt = dynamic_cast<ReturnStmtAST*>(stmt)) {
-            if (retStmt->value) {
-                throw evalExpr(retStmt->value.get());  // Use exception for control flow
-            }
-            throw RuntimeValue();
+        case StmtKind::Return: {
+            auto* retStmt = static_cast<ReturnStmtAST*>(stmt);
+            return Completion(Completion::Return, evalExpr(retStmt->value.get()));
         }
         
-        if (auto* ifStmt = dynamic_cast<IfStmtAST*>(stmt)) {
+        case StmtKind::If: {
+            auto* ifStmt = static_cast<IfStmtAST*>(stmt);
             RuntimeValue cond = evalExpr(ifStmt->condition.get());
-            if (cond.toBool()) {
-                pushScope();
-                for (auto& s : ifStmt->thenBody) {
-                    executeStmt(s.get());
-                }
-                popScope();
-            } else if (!ifStmt->elseBody.empty()) {
-                pushScope();
-                for (auto& s : ifStmt->elseBody) {
-                    executeStmt(s.get());
-                }
-                popScope();
-            }
-            return RuntimeValue();
+            Completion c = executeBlock(cond.toBool() ? ifStmt->thenBody : ifStmt->elseBody);
+            if (c.status != Completion::Normal) return c;
+            return Completion();
         }
         
-        if (auto* whileStmt = dynamic_cast<WhileStmtAST*>(stmt)) {
+        case StmtKind::While: {
+            auto* whileStmt = static_cast<WhileStmtAST*>(stmt);
             while (evalExpr(whileStmt->condition.get()).toBool()) {
-                pushScope();
-                for (auto& s : whileStmt->body) {
-                    executeStmt(s.get());
-                }
-                popScope();
+                Heap::safePoint();
+                Completion c = executeBlock(whileStmt->body);
+                if (c.status == Completion::Break) break;
+                if (c.status == Completion::Return) return c;
             }
-            return RuntimeValue();
+            return Completion();
         }
         
-        if (auto* forStmt = dynamic_cast<ForStmtAST*>(stmt)) {
-            RuntimeValue iterable = evalExpr(forStmt->iterable.get());
-            if (iterable.type == ValueType::Array) {
-                for (auto& item : iterable.arrayVal) {
-                    pushScope();
-                    setVar(forStmt->varName, item);
-                    try {
-                        for (auto& s : forStmt->body) {
-                            executeStmt(s.get());
-                        }
-                    } catch (const BreakException&) {
-                        popScope();
-                        break;
-                    } catch (const ContinueException&) {
-                        // Continue to next iteration
-                    }
-                    popScope();
+        case StmtKind::For: {
+            auto* forStmt = static_cast<ForStmtAST*>(stmt);
+            if (!forStmt->iterInPlace) {
+                slot(forStmt->iterSlot) = evalExpr(forStmt->iterable.get());
+            }
+            for (long long i = 0; ; i++) {
+                // Looked up every pass: calls in the body may move the stack
+                const RuntimeValue& iterable = slot(forStmt->iterSlot);
+                if (iterable.type == ValueType::Range) {
+                    if (i >= iterable.rangeSize()) break;
+                    setVar(forStmt->var, RuntimeValue(iterable.rangeAt(i)));
+                } else if (iterable.type == ValueType::Array) {
+                    if (i >= (long long)iterable.array().size()) break;
+                    setVar(forStmt->var, iterable.array()[i]);
+                } else {
+                    break;
                 }
+                Heap::safePoint();
+                Completion c = executeBlock(forStmt->body);
+                if (c.status == Completion::Break) break;
+                if (c.status == Completion::Return) return c;
             }
-            return RuntimeValue();
+            return Completion();
         }
         
-        // Try-Catch statement
-        if (auto* tryStmt = dynamic_cast<TryCatchStmtAST*>(stmt)) {
+        // Try-Catch statement. Like the VM, finally only runs when the try
+        // or catch body finishes normally.
+        case StmtKind::TryCatch: {
+            auto* tryStmt = static_cast<TryCatchStmtAST*>(stmt);
+            Completion c;
             try {
-                pushScope();
-                for (auto& s : tryStmt->tryBody) {
-                    executeStmt(s.get());
-                }
-                popScope();
+                c = executeBlock(tryStmt->tryBody);
             } catch (const OmniException& e) {
-                popScope();
-                pushScope();
                 // Bind exception to variable
-                RuntimeValue exVal;
-                exVal.type = ValueType::String;
-                exVal.stringVal = e.message;
-                setVar(tryStmt->exceptionVar, exVal);
+                setVar(tryStmt->exceptionRef, RuntimeValue(e.message));
                 
-                for (auto& s : tryStmt->catchBody) {
-                    executeStmt(s.get());
-                }
-                popScope();
+                c = executeBlock(tryStmt->catchBody);
             }
+            if (c.status != Completion::Normal) return c;
             
             // Execute finally block if present
-            if (!tryStmt->finallyBody.empty()) {
-                pushScope();
-                for (auto& s : tryStmt->finallyBody) {
-                    executeStmt(s.get());
-                }
-                popScope();
-            }
-            
-            return RuntimeValue();
+            c = executeBlock(tryStmt->finallyBody);
+            if (c.status != Completion::Normal) return c;
+            return Completion();
         }
         
         // Throw statement
-        if (auto* throwStmt = dynamic_cast<ThrowStmtAST*>(stmt)) {
+        case StmtKind::Throw: {
+            auto* throwStmt = static_cast<ThrowStmtAST*>(stmt);
             RuntimeValue val = evalExpr(throwStmt->exception.get());
             throw OmniException(val.toString(), currentLine);
         }
         
         // Break statement
-        if (dynamic_cast<BreakStmtAST*>(stmt)) {
-            throw BreakException();
-        }
+        case StmtKind::Break:
+            return Completion(Completion::Break);
         
         // Continue statement
-        if (dynamic_cast<ContinueStmtAST*>(stmt)) {
-            throw ContinueException();
+        case StmtKind::Continue:
+            return Completion(Completion::Continue);
         }
         
-        return RuntimeValue();
+        return Completion();
     }
     
     RuntimeValue evalExpr(ExprAST* expr) {
         if (!expr) return RuntimeValue();
         if (expr->line > 0) currentLine = expr->line;
 
-        
-        if (auto* num = dynamic_cast<NumberExprAST*>(expr)) {
-            if (num->value == (long long)num->value) {
-                return RuntimeValue((long long)num->value);
-            }
+        switch (expr->kind) {
+        case ExprKind::Number: {
+            auto* num = static_cast<NumberExprAST*>(expr);
+            if (num->isInt) return RuntimeValue(num->intValue);
             return RuntimeValue(num->value);
         }
         
-        if (auto* str = dynamic_cast<StringExprAST*>(expr)) {
-            return RuntimeValue(str->value);
+        case ExprKind::String: {
+            auto* str = static_cast<StringExprAST*>(expr);
+            return RuntimeValue::literal(str->symbol);
         }
         
         // F-String interpolation: f"Hello {name}!"
-        if (auto* fstr = dynamic_cast<FStringExprAST*>(expr)) {
+        case ExprKind::FString: {
+            auto* fstr = static_cast<FStringExprAST*>(expr);
             std::string result;
-            std::string& tmpl = fstr->value;
-            size_t i = 0;
-            while (i < tmpl.length()) {
-                if (tmpl[i] == '{') {
-                    size_t end = tmpl.find('}', i);
-                    if (end != std::string::npos) {
-                        std::string varName = tmpl.substr(i + 1, end - i - 1);
-                        RuntimeValue val = getVar(varName);
-                        result += val.toString();
-                        i = end + 1;
-                        continue;
-                    }
+            result.reserve(fstr->sizeHint);
+            for (auto& part : fstr->parts) {
+                if (!part.expr) {
+                    result += part.text;
+                } else if (part.spec) {
+                    Operators::appendFormatted(result, evalExpr(part.expr.get()), *part.spec, fstr->line);
+                } else {
+                    Operators::appendText(result, evalExpr(part.expr.get()));
                 }
-                result += tmpl[i++];
             }
-            return RuntimeValue(result);
+            return RuntimeValue(std::move(result));
         }
         
-        if (auto* var = dynamic_cast<VariableExprAST*>(expr)) {
-            // Check for boolean literals
-            if (var->name == "true") return RuntimeValue(true);
-            if (var->name == "false") return RuntimeValue(false);
-            if (var->name == "null") return RuntimeValue();
-            return getVar(var->name);
+        case ExprKind::Variable: {
+            return getVar(static_cast<VariableExprAST*>(expr));
         }
         
-        if (dynamic_cast<SelfExprAST*>(expr)) {
-            return getVar("self");
-        }
+        case ExprKind::Self:
+            return slot(0);
         
-        if (auto* binary = dynamic_cast<BinaryExprAST*>(expr)) {
+        case ExprKind::Binary: {
+            auto* binary = static_cast<BinaryExprAST*>(expr);
             RuntimeValue left = evalExpr(binary->lhs.get());
+            // && and || only evaluate the right side when it decides the result
+            if (binary->op == BinaryOp::And && !left.toBool()) return RuntimeValue(false);
+            if (binary->op == BinaryOp::Or && left.toBool()) return RuntimeValue(true);
             RuntimeValue right = evalExpr(binary->rhs.get());
+            if (binary->reusedVar.kind != VarRef::Unresolved) {
+                variable(binary->reusedVar) = RuntimeValue();
+            }
             return evalBinaryOp(binary->op, left, right);
         }
         
-        if (auto* unary = dynamic_cast<UnaryExprAST*>(expr)) {
+        case ExprKind::Unary: {
+            auto* unary = static_cast<UnaryExprAST*>(expr);
             RuntimeValue val = evalExpr(unary->operand.get());
-            if (unary->op == "!") return RuntimeValue(!val.toBool());
-            if (unary->op == "-") return RuntimeValue(-val.toDouble());
-            return val;
+            return Operators::unary(unary->op, val);
         }
         
-        if (auto* call = dynamic_cast<CallExprAST*>(expr)) {
+        case ExprKind::Call: {
+            auto* call = static_cast<CallExprAST*>(expr);
             std::vector<RuntimeValue> args;
             for (auto& arg : call->args) {
                 args.push_back(evalExpr(arg.get()));
             }
             
-            // Check stdlib first
-            if (StdLib::hasFunction(call->callee)) {
-                return StdLib::call(call->callee, args);
+            // Builtins win over user functions
+            if (call->native) {
+                return (*call->native)(args);
             }
             
-            // Check user functions
-            if (functions.count(call->callee)) {
-                return executeFunction(functions[call->callee], args);
+            // Then a lambda held by a variable of the same name
+            if (call->closure.kind != VarRef::Unresolved) {
+                RuntimeValue callee = variable(call->closure);
+                if (callee.type == ValueType::Lambda) return callLambda(callee, args.data(), (int)args.size());
+            }
+            
+            if (call->functionEpoch != functionsEpoch) {
+                auto it = functions.find(call->callee);
+                call->function = it != functions.end() ? it->second : nullptr;
+                call->functionEpoch = functionsEpoch;
+            }
+            if (call->function) {
+                return executeFunction(call->function, RuntimeValue(), args);
             }
             
             throw OmniException("Unknown function: " + call->callee, currentLine);
         }
         
-        if (auto* newExpr = dynamic_cast<NewExprAST*>(expr)) {
+        case ExprKind::New: {
+            auto* newExpr = static_cast<NewExprAST*>(expr);
             return createObject(newExpr->className, newExpr->args);
         }
         
-        if (auto* member = dynamic_cast<MemberAccessExprAST*>(expr)) {
+        case ExprKind::MemberAccess: {
+            auto* member = static_cast<MemberAccessExprAST*>(expr);
             RuntimeValue obj = evalExpr(member->object.get());
-            if (obj.type == ValueType::Object) {
-                return obj.objectVal[member->memberName];
-            }
-            return RuntimeValue();
+            const RuntimeValue* value = obj.findField(member->member, member->cache);
+            return value ? *value : RuntimeValue();
         }
         
-        if (auto* methodCall = dynamic_cast<MethodCallExprAST*>(expr)) {
-            // First check if it's a module call (Math.sqrt, File.read, etc.)
-            if (auto* varExpr = dynamic_cast<VariableExprAST*>(methodCall->object.get())) {
-                std::string moduleName = varExpr->name;
-                std::string fullName = moduleName + "." + methodCall->methodName;
-                
-                if (StdLib::hasFunction(fullName)) {
-                    std::vector<RuntimeValue> args;
-                    for (auto& arg : methodCall->args) {
-                        args.push_back(evalExpr(arg.get()));
-                    }
-                    return StdLib::call(fullName, args);
+        case ExprKind::MethodCall: {
+            auto* methodCall = static_cast<MethodCallExprAST*>(expr);
+            // Module call (Math.sqrt, File.read, etc.)
+            if (methodCall->moduleFunc) {
+                std::vector<RuntimeValue> args;
+                for (auto& arg : methodCall->args) {
+                    args.push_back(evalExpr(arg.get()));
+                }
+                if (methodCall->reusedVar.kind != VarRef::Unresolved) {
+                    variable(methodCall->reusedVar) = RuntimeValue();
+                }
+                if (auto* field = methodCall->reusedField) {
+                    RuntimeValue obj = evalExpr(field->object.get());
+                    if (obj.type == ValueType::Object) obj.field(field->member, field->cache) = RuntimeValue();
                 }
+                return (*methodCall->moduleFunc)(args);
             }
             
             RuntimeValue obj = evalExpr(methodCall->object.get());
@@ -469,156 +516,160 @@ private:
             
             // Handle string methods
             if (obj.type == ValueType::String) {
-                std::string methodName = "String." + methodCall->methodName;
-                if (StdLib::hasFunction(methodName)) {
+                if (methodCall->stringMethod) {
                     std::vector<RuntimeValue> allArgs = {obj};
                     allArgs.insert(allArgs.end(), args.begin(), args.end());
-                    return StdLib::call(methodName, allArgs);
+                    return (*methodCall->stringMethod)(allArgs);
                 }
                 
                 // Built-in string methods
                 if (methodCall->methodName == "length") {
-                    return RuntimeValue((long long)obj.stringVal.length());
+                    return RuntimeValue((long long)obj.str().length());
                 }
             }
             
             // Handle object methods
-            if (obj.type == ValueType::Object && obj.objectVal.count("__class__")) {
-                std::string className = obj.objectVal["__class__"].stringVal;
-                if (classes.count(className)) {
-                    auto* cls = classes[className];
-                    for (auto& method : cls->methods) {
-                        if (method->name == methodCall->methodName) {
-                            pushScope();
-                            setVar("self", obj);
-                            RuntimeValue result = executeFunction(method.get(), args);
-                            popScope();
-                            return result;
-                        }
+            if (obj.type == ValueType::Object) {
+                if (const ClassAST* cls = classOf(obj)) {
+                    if (FunctionAST* method = methodCall->lookupMethod(cls)) {
+                        return executeFunction(method, obj, args);
                     }
                 }
             }
             
+            // Array and map methods; instances made with new are not maps
+            const NativeFunc* native = nullptr;
+            if (obj.type == ValueType::Array) native = methodCall->arrayMethod;
+            if (obj.type == ValueType::Object && !obj.klass()) native = methodCall->mapMethod;
+            if (native) {
+                args.insert(args.begin(), std::move(obj));
+                return (*native)(args);
+            }
+            
             return RuntimeValue();
         }
         
-        if (auto* arr = dynamic_cast<ArrayExprAST*>(expr)) {
-            RuntimeValue result;
-            result.type = ValueType::Array;
+        case ExprKind::Array: {
+            auto* arr = static_cast<ArrayExprAST*>(expr);
+            std::vector<RuntimeValue> items;
+            items.reserve(arr->elements.size());
             for (auto& elem : arr->elements) {
-                result.arrayVal.push_back(evalExpr(elem.get()));
+                items.push_back(evalExpr(elem.get()));
             }
-            return result;
+            return RuntimeValue::newArray(std::move(items));
         }
         
-        if (auto* idx = dynamic_cast<IndexExprAST*>(expr)) {
+        case ExprKind::Index: {
+            auto* idx = static_cast<IndexExprAST*>(expr);
             RuntimeValue arr = evalExpr(idx->array.get());
             RuntimeValue index = evalExpr(idx->index.get());
+            if (arr.type == ValueType::Object) {
+                const RuntimeValue* value = arr.findField(index.toSymbol());
+                return value ? *value : RuntimeValue();
+            }
             if (arr.type == ValueType::Array) {
                 int i = (int)index.toInt();
-                if (i >= 0 && i < (int)arr.arrayVal.size()) {
-                    return arr.arrayVal[i];
+                if (i >= 0 && i < (int)arr.array().size()) {
+                    return arr.array()[i];
+                }
+            }
+            if (arr.type == ValueType::Range) {
+                long long i = index.toInt();
+                if (i >= 0 && i < arr.rangeSize()) {
+                    return RuntimeValue(arr.rangeAt(i));
                 }
             }
             if (arr.type == ValueType::String) {
                 int i = (int)index.toInt();
-                if (i >= 0 && i < (int)arr.stringVal.length()) {
-                    return RuntimeValue(std::string(1, arr.stringVal[i]));
+                if (i >= 0 && i < (int)arr.str().length()) {
+                    return RuntimeValue(std::string(1, arr.str()[i]));
                 }
             }
             return RuntimeValue();
         }
         
+        case ExprKind::Concat: {
+            auto* concat = static_cast<ConcatExprAST*>(expr);
+            std::vector<RuntimeValue> parts;
+            parts.reserve(concat->parts.size());
+            for (auto& part : concat->parts) {
+                parts.push_back(evalExpr(part.get()));
+            }
+            if (concat->reusedVar.kind != VarRef::Unresolved) {
+                variable(concat->reusedVar) = RuntimeValue();
+            }
+            return Operators::concat(parts.data(), parts.size());
+        }
+        
         // Lambda expression: x -> x * 2
-        if (auto* lambda = dynamic_cast<LambdaExprAST*>(expr)) {
-            RuntimeValue result;
-            result.type = ValueType::Lambda;
-            result.lambdaParams = lambda->params;
-            result.lambdaBody = lambda->body.get();
-            return result;
+        case ExprKind::Lambda: {
+            auto* lambda = static_cast<LambdaExprAST*>(expr);
+            std::vector<RuntimeValue> env;
+            env.reserve(1 + lambda->captures.size());
+            env.push_back(slot(0));
+            for (auto& captured : lambda->captures) {
+                env.push_back(variable(captured));
+            }
+            return RuntimeValue::makeLambda(lambda, nullptr, std::move(env), codeOwner);
+        }
         }
         
         return RuntimeValue();
     }
     
-    RuntimeValue evalBinaryOp(const std::string& op, RuntimeValue& left, RuntimeValue& right) {
-        // String concatenation
-        if (op == "+" && (left.type == ValueType::String || right.type == ValueType::String)) {
-            return RuntimeValue(left.toString() + right.toString());
-        }
-        
-        // Numeric operations
-        if (op == "+") return RuntimeValue(left.toDouble() + right.toDouble());
-        if (op == "-") return RuntimeValue(left.toDouble() - right.toDouble());
-        if (op == "*") return RuntimeValue(left.toDouble() * right.toDouble());
-        if (op == "/") {
-            if (right.toDouble() == 0) return RuntimeValue(0.0);
-            return RuntimeValue(left.toDouble() / right.toDouble());
-        }
-        if (op == "%") return RuntimeValue((long long)left.toInt() % (long long)right.toInt());
-        
-        // Comparisons
-        if (op == "==" || op == "e") {
-            if (left.type == ValueType::String && right.type == ValueType::String)
-                return RuntimeValue(left.stringVal == right.stringVal);
-            return RuntimeValue(left.toDouble() == right.toDouble());
-        }
-        if (op == "!=") return RuntimeValue(left.toDouble() != right.toDouble());
-        if (op == "<")  return RuntimeValue(left.toDouble() < right.toDouble());
-        if (op == ">")  return RuntimeValue(left.toDouble() > right.toDouble());
-        if (op == "<=") return RuntimeValue(left.toDouble() <= right.toDouble());
-        if (op == ">=") return RuntimeValue(left.toDouble() >= right.toDouble());
-        
-        // Logical
-        if (op == "&&") return RuntimeValue(left.toBool() && right.toBool());
-        if (op == "||") return RuntimeValue(left.toBool() || right.toBool());
-        
-        return RuntimeValue();
+    RuntimeValue evalBinaryOp(BinaryOp op, RuntimeValue& left, RuntimeValue& right) {
+        if (op == BinaryOp::Add) return Operators::addTo(left, right);
+        return Operators::binary(op, left, right, currentLine);
     }
     
-    RuntimeValue createObject(const std::string& className, std::vector<std::unique_ptr<ExprAST>>& argExprs) {
-        RuntimeValue obj;
-        obj.type = ValueType::Object;
-        obj.objectVal["__class__"] = RuntimeValue(className);
-        
-        if (classes.count(className)) {
-            auto* cls = classes[className];
+    // Objects made with new carry their class; others (e.g. parsed JSON)
+    // are looked up by their __class__ name.
+    const ClassAST* classOf(const RuntimeValue& obj) {
+        if (obj.klass()) return obj.klass();
+        static const Symbol classKey("__class__");
+        const RuntimeValue* name = obj.findField(classKey);
+        if (!name) return nullptr;
+        auto cls = classes.find(name->str());
+        return cls != classes.end() ? cls->second : nullptr;
+    }
+    
+    // Parent fields first, so a subclass may override their initial values
+    void initFields(ClassAST* cls) {
+        if (cls->parent) initFields(cls->parent);
+        for (auto& field : cls->fields) {
+            RuntimeValue val;
+            if (field.initializer) val = evalExpr(field.initializer.get());
+            slot(0).field(field.name) = val;
+        }
+    }
+    
+    RuntimeValue createObject(const std::string& className, std::vector<ExprPtr>& argExprs) {
+        auto found = classes.find(className);
+        ClassAST* cls = found != classes.end() ? found->second : nullptr;
+        RuntimeValue obj = RuntimeValue::newObject(cls);
+        static const Symbol classKey("__class__");
+        obj.field(classKey) = RuntimeValue::literal(className);
+        
+        if (cls) {
             
-            // Initialize fields
-            for (auto& field : cls->fields) {
-                if (field.initializer) {
-                    obj.objectVal[field.name] = evalExpr(field.initializer.get());
-                } else {
-                    obj.objectVal[field.name] = RuntimeValue();
-                }
+            // Initialize fields in a frame holding only the new object
+            {
+                size_t base = stack.size();
+                stack.resize(base + 1);
+                FrameGuard guard{*this, frameBase, base};
+                frameBase = base;
+                slot(0) = std::move(obj);
+                initFields(cls);
+                obj = std::move(slot(0));
             }
             
             // Run constructor
-            if (cls->constructor) {
+            if (cls->initializer) {
                 std::vector<RuntimeValue> args;
                 for (auto& argExpr : argExprs) {
                     args.push_back(evalExpr(argExpr.get()));
                 }
-                
-                pushScope();
-                setVar("self", obj);
-                
-                // Bind constructor args (skip 'self')
-                size_t argIdx = 0;
-                for (auto& param : cls->constructor->args) {
-                    if (param.name != "self" && argIdx < args.size()) {
-                        setVar(param.name, args[argIdx++]);
-                    }
-                }
-                
-                // Execute constructor body
-                for (auto& stmt : cls->constructor->body) {
-                    executeStmt(stmt.get());
-                }
-                
-                // Get updated self
-                obj = getVar("self");
-                popScope();
+                obj = executeFunction(cls->initializer, obj, args, true);
             }
         }
         
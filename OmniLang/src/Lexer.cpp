@@ -61,6 +61,7 @@ Lexer::Lexer(const std::string& source) : src(source) {
 
 std::vector<Token> Lexer::tokenize() {
     std::vector<Token> tokens;
+    tokens.reserve(src.length() / 3);   // Typical code has a token every 3-4 characters
 
     while (pos < src.length()) {
         char current = peek();
@@ -111,8 +112,9 @@ std::vector<Token> Lexer::tokenize() {
                             case 'n': text += '\n'; break;
                             case 't': text += '\t'; break;
                             case '\\': text += '\\'; break;
-                            case '{': text += '{'; break;
-                            case '}': text += '}'; break;
+                            // Doubled, as the parser reads {{ and }} as literal braces
+                            case '{': text += "{{"; break;
+                            case '}': text += "}}"; break;
                             default: text += escaped;
                         }
                     } else {
@@ -204,6 +206,7 @@ std::vector<Token> Lexer::tokenize() {
             case '}': tokens.push_back({TokenType::RBrace, "}", line, col}); break;
             default:
                 std::cerr << "Unexpected character: " << current << " at line " << line << std::endl;
+                errors++;
         }
         advance();
     }
@@ -261,10 +264,9 @@ bool Lexer::match(char expected) {
 }
 
 Token Lexer::identifier() {
-    std::string text;
-    while (isalnum(peek()) || peek() == '_') {
-        text += advance();
-    }
+    int start = pos;
+    while (isalnum(peek()) || peek() == '_') advance();
+    std::string text = src.substr(start, pos - start);
 
     TokenType type = TokenType::Identifier;
     auto it = keywords.find(text);
@@ -295,17 +297,18 @@ Token Lexer::string(char quote) {
     advance(); // Skip opening quote
     std::string text;
     while (peek() != quote && peek() != '\0') {
-        if (peek() == '\\') {
-            advance();
-            char escaped = advance();
-            switch (escaped) {
-                case 'n': text += '\n'; break;
-                case 't': text += '\t'; break;
-                case '\\': text += '\\'; break;
-                default: text += escaped;
-            }
-        } else {
-            text += advance();
+        // Copy the run up to the next escape in one go
+        int start = pos;
+        while (peek() != quote && peek() != '\\' && peek() != '\0') advance();
+        text.append(src, start, pos - start);
+        if (peek() != '\\') break;
+        advance();
+        char escaped = advance();
+        switch (escaped) {
+            case 'n': text += '\n'; break;
+            case 't': text += '\t'; break;
+            case '\\': text += '\\'; break;
+            default: text += escaped;
         }
     }
     advance(); // Skip closing quote
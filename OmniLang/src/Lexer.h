@@ -8,12 +8,14 @@ class Lexer {
 public:
     Lexer(const std::string& source);
     std::vector<Token> tokenize();
+    bool hadErrors() const { return errors > 0; }  // Some character was skipped
 
 private:
     std::string src;
     int pos = 0;
     int line = 1;
     int col = 1;
+    int errors = 0;
     
     std::stack<int> indentStack;
 
@@ -0,0 +1,696 @@
+#include "ModuleCache.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+
+static const char kMagic[8] = {'O', 'M', 'N', 'I', 'C', 0, 0, 0};
+static const uint32_t kByteOrder = 0x01020304;
+
+//===----------------------------------------------------------------------===//
+// Encoding
+//===----------------------------------------------------------------------===//
+
+// Fixed-size values are stored in host byte order; the header's byte-order
+// mark turns away caches written on a host that differs. A node is its kind plus one (0 for a missing
+// node), its line, then its fields in declaration order.
+class AstWriter {
+public:
+    std::string out;
+
+    void u8(uint8_t v) { out.push_back((char)v); }
+    void u32(uint32_t v) { raw(&v, sizeof v); }
+    void i64(long long v) { raw(&v, sizeof v); }
+    void f64(double v) { raw(&v, sizeof v); }
+    void str(const std::string& s) {
+        u32((uint32_t)s.size());
+        out.append(s);
+    }
+
+    void type(const TypeInfo& t) {
+        str(t.name);
+        u8(t.isArray);
+        str(t.genericParam);
+    }
+
+    void exprs(const std::vector<ExprPtr>& list) {
+        u32((uint32_t)list.size());
+        for (auto& e : list) expr(e.get());
+    }
+
+    void block(const std::vector<StmtPtr>& body) {
+        u32((uint32_t)body.size());
+        for (auto& s : body) stmt(s.get());
+    }
+
+    void expr(const ExprAST* e) {
+        if (!e) {
+            u8(0);
+            return;
+        }
+        u8((uint8_t)e->kind + 1);
+        u32((uint32_t)e->line);
+        switch (e->kind) {
+        case ExprKind::Number: {
+            auto* n = static_cast<const NumberExprAST*>(e);
+            f64(n->value);
+            u8(n->isInt);
+            i64(n->intValue);
+            break;
+        }
+        case ExprKind::String:
+            str(static_cast<const StringExprAST*>(e)->value);
+            break;
+        case ExprKind::FString: {
+            auto* f = static_cast<const FStringExprAST*>(e);
+            str(f->value);
+            i64((long long)f->sizeHint);
+            u32((uint32_t)f->parts.size());
+            for (auto& part : f->parts) {
+                str(part.text);
+                expr(part.expr.get());
+                u8(part.spec != nullptr);
+                if (part.spec) {
+                    const FormatSpec& spec = *part.spec;
+                    u8((uint8_t)spec.fill);
+                    u8((uint8_t)spec.align);
+                    u8(spec.plus);
+                    u8(spec.zeroPad);
+                    u8(spec.grouping);
+                    u32((uint32_t)spec.width);
+                    u32((uint32_t)spec.precision);
+                    u8((uint8_t)spec.type);
+                }
+            }
+            break;
+        }
+        case ExprKind::Variable:
+            str(static_cast<const VariableExprAST*>(e)->name);
+            break;
+        case ExprKind::Binary: {
+            auto* b = static_cast<const BinaryExprAST*>(e);
+            u8((uint8_t)b->op);
+            expr(b->lhs.get());
+            expr(b->rhs.get());
+            break;
+        }
+        case ExprKind::Unary: {
+            auto* u = static_cast<const UnaryExprAST*>(e);
+            u8((uint8_t)u->op);
+            expr(u->operand.get());
+            break;
+        }
+        case ExprKind::Call: {
+            auto* c = static_cast<const CallExprAST*>(e);
+            str(c->callee);
+            exprs(c->args);
+            break;
+        }
+        case ExprKind::MethodCall: {
+            auto* m = static_cast<const MethodCallExprAST*>(e);
+            expr(m->object.get());
+            str(m->methodName);
+            exprs(m->args);
+            break;
+        }
+        case ExprKind::MemberAccess: {
+            auto* m = static_cast<const MemberAccessExprAST*>(e);
+            expr(m->object.get());
+            str(m->memberName);
+            break;
+        }
+        case ExprKind::New: {
+            auto* n = static_cast<const NewExprAST*>(e);
+            str(n->className);
+            exprs(n->args);
+            break;
+        }
+        case ExprKind::Array:
+            exprs(static_cast<const ArrayExprAST*>(e)->elements);
+            break;
+        case ExprKind::Lambda: {
+            auto* l = static_cast<const LambdaExprAST*>(e);
+            u32((uint32_t)l->params.size());
+            for (auto& p : l->params) str(p);
+            expr(l->body.get());
+            break;
+        }
+        case ExprKind::Index: {
+            auto* i = static_cast<const IndexExprAST*>(e);
+            expr(i->array.get());
+            expr(i->index.get());
+            break;
+        }
+        case ExprKind::Concat:
+            exprs(static_cast<const ConcatExprAST*>(e)->parts);
+            break;
+        case ExprKind::Self:
+            break;
+        }
+    }
+
+    void stmt(const StmtAST* s) {
+        if (!s) {
+            u8(0);
+            return;
+        }
+        u8((uint8_t)s->kind + 1);
+        u32((uint32_t)s->line);
+        switch (s->kind) {
+        case StmtKind::Expr:
+            expr(static_cast<const ExprStmtAST*>(s)->expr.get());
+            break;
+        case StmtKind::Return:
+            expr(static_cast<const ReturnStmtAST*>(s)->value.get());
+            break;
+        case StmtKind::VarDecl: {
+            auto* v = static_cast<const VarDeclStmtAST*>(s);
+            str(v->name);
+            type(v->type);
+            expr(v->initializer.get());
+            break;
+        }
+        case StmtKind::Assign: {
+            auto* a = static_cast<const AssignStmtAST*>(s);
+            expr(a->target.get());
+            expr(a->value.get());
+            u8(a->compound);
+            u8((uint8_t)a->op);
+            break;
+        }
+        case StmtKind::If: {
+            auto* i = static_cast<const IfStmtAST*>(s);
+            expr(i->condition.get());
+            block(i->thenBody);
+            block(i->elseBody);
+            break;
+        }
+        case StmtKind::While: {
+            auto* w = static_cast<const WhileStmtAST*>(s);
+            expr(w->condition.get());
+            block(w->body);
+            break;
+        }
+        case StmtKind::For: {
+            auto* f = static_cast<const ForStmtAST*>(s);
+            str(f->varName);
+            expr(f->iterable.get());
+            block(f->body);
+            break;
+        }
+        case StmtKind::TryCatch: {
+            auto* t = static_cast<const TryCatchStmtAST*>(s);
+            block(t->tryBody);
+            str(t->exceptionVar);
+            str(t->exceptionType);
+            block(t->catchBody);
+            block(t->finallyBody);
+            break;
+        }
+        case StmtKind::Throw:
+            expr(static_cast<const ThrowStmtAST*>(s)->exception.get());
+            break;
+        case StmtKind::Break:
+        case StmtKind::Continue:
+            break;
+        }
+    }
+
+    void function(const FunctionAST& f) {
+        u8((uint8_t)f.access);
+        u8(f.isStatic);
+        str(f.name);
+        u32((uint32_t)f.args.size());
+        for (auto& arg : f.args) {
+            str(arg.name);
+            type(arg.type);
+        }
+        type(f.returnType);
+        block(f.body);
+    }
+
+    void program(const ProgramAST& p) {
+        u32((uint32_t)p.imports.size());
+        for (auto& imp : p.imports) str(imp->moduleName);
+
+        u32((uint32_t)p.classes.size());
+        for (auto& cls : p.classes) {
+            str(cls->name);
+            str(cls->parentClass);
+            u32((uint32_t)cls->interfaces.size());
+            for (auto& name : cls->interfaces) str(name);
+            u32((uint32_t)cls->fields.size());
+            for (auto& field : cls->fields) {
+                u8((uint8_t)field.access);
+                type(field.type);
+                str(field.name);
+                expr(field.initializer.get());
+            }
+            u32((uint32_t)cls->methods.size());
+            for (auto& method : cls->methods) function(*method);
+            u8(cls->constructor != nullptr);
+            if (cls->constructor) function(*cls->constructor);
+        }
+
+        u32((uint32_t)p.interfaces.size());
+        for (auto& iface : p.interfaces) {
+            str(iface->name);
+            u32((uint32_t)iface->methods.size());
+            for (auto& method : iface->methods) function(*method);
+        }
+
+        u32((uint32_t)p.functions.size());
+        for (auto& func : p.functions) function(*func);
+    }
+
+private:
+    void raw(const void* data, size_t size) { out.append((const char*)data, size); }
+};
+
+// Rebuilds what AstWriter wrote. Running past the end or meeting an
+// unknown node kind throws, and the cache is then ignored.
+class AstReader {
+public:
+    AstReader(const char* data, size_t size, std::shared_ptr<AstArena> arena)
+        : pos(data), end(data + size), arena(std::move(arena)) {}
+
+    bool atEnd() const { return pos == end; }
+    std::string_view rest() const { return std::string_view(pos, end - pos); }
+
+    uint8_t u8() {
+        uint8_t v;
+        raw(&v, sizeof v);
+        return v;
+    }
+    uint32_t u32() {
+        uint32_t v;
+        raw(&v, sizeof v);
+        return v;
+    }
+    long long i64() {
+        long long v;
+        raw(&v, sizeof v);
+        return v;
+    }
+    double f64() {
+        double v;
+        raw(&v, sizeof v);
+        return v;
+    }
+    std::string str() {
+        uint32_t size = u32();
+        need(size);
+        std::string s(pos, size);
+        pos += size;
+        return s;
+    }
+
+    TypeInfo type() {
+        TypeInfo t;
+        t.name = str();
+        t.isArray = u8();
+        t.genericParam = str();
+        return t;
+    }
+
+    std::vector<ExprPtr> exprs() {
+        uint32_t count = u32();
+        std::vector<ExprPtr> list;
+        list.reserve(std::min<size_t>(count, end - pos));
+        for (uint32_t i = 0; i < count; i++) list.push_back(expr());
+        return list;
+    }
+
+    std::vector<StmtPtr> block() {
+        uint32_t count = u32();
+        std::vector<StmtPtr> body;
+        body.reserve(std::min<size_t>(count, end - pos));
+        for (uint32_t i = 0; i < count; i++) body.push_back(stmt());
+        return body;
+    }
+
+    // Operands are read into locals first: arguments of one call may be
+    // evaluated in any order
+    ExprPtr expr() {
+        uint8_t tag = u8();
+        if (tag == 0) return nullptr;
+        int line = (int)u32();
+        ExprPtr node;
+        switch ((ExprKind)(tag - 1)) {
+        case ExprKind::Number: {
+            double value = f64();
+            bool isInt = u8();
+            auto n = arena->make<NumberExprAST>(value, isInt);
+            n->intValue = i64();
+            node = std::move(n);
+            break;
+        }
+        case ExprKind::String:
+            node = arena->make<StringExprAST>(str());
+            break;
+        case ExprKind::FString: {
+            auto f = arena->make<FStringExprAST>(str());
+            f->sizeHint = (size_t)i64();
+            uint32_t count = u32();
+            for (uint32_t i = 0; i < count; i++) {
+                FStringPart part;
+                part.text = str();
+                part.expr = expr();
+                if (u8()) {
+                    part.spec = std::make_unique<FormatSpec>();
+                    FormatSpec& spec = *part.spec;
+                    spec.fill = (char)u8();
+                    spec.align = (char)u8();
+                    spec.plus = u8();
+                    spec.zeroPad = u8();
+                    spec.grouping = u8();
+                    spec.width = (int)u32();
+                    spec.precision = (int)u32();
+                    spec.type = (char)u8();
+                }
+                f->parts.push_back(std::move(part));
+            }
+            node = std::move(f);
+            break;
+        }
+        case ExprKind::Variable:
+            node = arena->make<VariableExprAST>(str());
+            break;
+        case ExprKind::Binary: {
+            BinaryOp op = (BinaryOp)u8();
+            ExprPtr lhs = expr();
+            ExprPtr rhs = expr();
+            node = arena->make<BinaryExprAST>(op, std::move(lhs), std::move(rhs));
+            break;
+        }
+        case ExprKind::Unary: {
+            UnaryOp op = (UnaryOp)u8();
+            node = arena->make<UnaryExprAST>(op, expr());
+            break;
+        }
+        case ExprKind::Call: {
+            std::string callee = str();
+            node = arena->make<CallExprAST>(callee, exprs());
+            break;
+        }
+        case ExprKind::MethodCall: {
+            ExprPtr object = expr();
+            std::string method = str();
+            node = arena->make<MethodCallExprAST>(std::move(object), method, exprs());
+            break;
+        }
+        case ExprKind::MemberAccess: {
+            ExprPtr object = expr();
+            node = arena->make<MemberAccessExprAST>(std::move(object), str());
+            break;
+        }
+        case ExprKind::New: {
+            std::string className = str();
+            node = arena->make<NewExprAST>(className, exprs());
+            break;
+        }
+        case ExprKind::Array:
+            node = arena->make<ArrayExprAST>(exprs());
+            break;
+        case ExprKind::Lambda: {
+            std::vector<std::string> params(u32Count());
+            for (auto& p : params) p = str();
+            node = arena->make<LambdaExprAST>(std::move(params), expr());
+            break;
+        }
+        case ExprKind::Index: {
+            ExprPtr array = expr();
+            ExprPtr index = expr();
+            node = arena->make<IndexExprAST>(std::move(array), std::move(index));
+            break;
+        }
+        case ExprKind::Concat:
+            node = arena->make<ConcatExprAST>(exprs());
+            break;
+        case ExprKind::Self:
+            node = arena->make<SelfExprAST>();
+            break;
+        default:
+            throw std::runtime_error("unknown expression kind");
+        }
+        node->line = line;
+        return node;
+    }
+
+    StmtPtr stmt() {
+        uint8_t tag = u8();
+        if (tag == 0) return nullptr;
+        int line = (int)u32();
+        StmtPtr node;
+        switch ((StmtKind)(tag - 1)) {
+        case StmtKind::Expr:
+            node = arena->make<ExprStmtAST>(expr());
+            break;
+        case StmtKind::Return:
+            node = arena->make<ReturnStmtAST>(expr());
+            break;
+        case StmtKind::VarDecl: {
+            std::string name = str();
+            TypeInfo t = type();
+            node = arena->make<VarDeclStmtAST>(name, t, expr());
+            break;
+        }
+        case StmtKind::Assign: {
+            ExprPtr target = expr();
+            ExprPtr value = expr();
+            auto a = arena->make<AssignStmtAST>(std::move(target), std::move(value));
+            a->compound = u8();
+            a->op = (BinaryOp)u8();
+            node = std::move(a);
+            break;
+        }
+        case StmtKind::If: {
+            ExprPtr cond = expr();
+            std::vector<StmtPtr> thenBody = block();
+            std::vector<StmtPtr> elseBody = block();
+            node = arena->make<IfStmtAST>(std::move(cond), std::move(thenBody), std::move(elseBody));
+            break;
+        }
+        case StmtKind::While: {
+            ExprPtr cond = expr();
+            node = arena->make<WhileStmtAST>(std::move(cond), block());
+            break;
+        }
+        case StmtKind::For: {
+            std::string var = str();
+            ExprPtr iterable = expr();
+            node = arena->make<ForStmtAST>(var, std::move(iterable), block());
+            break;
+        }
+        case StmtKind::TryCatch: {
+            std::vector<StmtPtr> tryBody = block();
+            std::string var = str();
+            std::string type = str();
+            std::vector<StmtPtr> catchBody = block();
+            std::vector<StmtPtr> finallyBody = block();
+            node = arena->make<TryCatchStmtAST>(std::move(tryBody), var, type, std::move(catchBody),
+                                                std::move(finallyBody));
+            break;
+        }
+        case StmtKind::Throw:
+            node = arena->make<ThrowStmtAST>(expr());
+            break;
+        case StmtKind::Break:
+            node = arena->make<BreakStmtAST>();
+            break;
+        case StmtKind::Continue:
+            node = arena->make<ContinueStmtAST>();
+            break;
+        default:
+            throw std::runtime_error("unknown statement kind");
+        }
+        node->line = line;
+        return node;
+    }
+
+    std::unique_ptr<FunctionAST> function() {
+        AccessModifier access = (AccessModifier)u8();
+        bool isStatic = u8();
+        std::string name = str();
+        std::vector<FuncArg> args(u32Count());
+        for (auto& arg : args) {
+            arg.name = str();
+            arg.type = type();
+        }
+        TypeInfo returnType = type();
+        auto func = std::make_unique<FunctionAST>(name, std::move(args), returnType, block());
+        func->arena = arena;
+        func->access = access;
+        func->isStatic = isStatic;
+        return func;
+    }
+
+    std::unique_ptr<ProgramAST> program() {
+        auto p = std::make_unique<ProgramAST>();
+        p->arena = arena;
+
+        for (uint32_t i = 0, n = u32(); i < n; i++) {
+            p->imports.push_back(std::make_unique<ImportAST>(str()));
+        }
+
+        for (uint32_t i = 0, n = u32(); i < n; i++) {
+            auto cls = std::make_unique<ClassAST>();
+            cls->arena = arena;
+            cls->name = str();
+            cls->parentClass = str();
+            cls->interfaces.resize(u32Count());
+            for (auto& name : cls->interfaces) name = str();
+            cls->fields.resize(u32Count());
+            for (auto& field : cls->fields) {
+                field.access = (AccessModifier)u8();
+                field.type = type();
+                field.name = str();
+                field.initializer = expr();
+            }
+            for (uint32_t j = 0, m = u32(); j < m; j++) cls->methods.push_back(function());
+            if (u8()) cls->constructor = function();
+            p->classes.push_back(std::move(cls));
+        }
+
+        for (uint32_t i = 0, n = u32(); i < n; i++) {
+            auto iface = std::make_unique<InterfaceAST>();
+            iface->name = str();
+            for (uint32_t j = 0, m = u32(); j < m; j++) iface->methods.push_back(function());
+            p->interfaces.push_back(std::move(iface));
+        }
+
+        for (uint32_t i = 0, n = u32(); i < n; i++) p->functions.push_back(function());
+        return p;
+    }
+
+private:
+    const char* pos;
+    const char* end;
+    std::shared_ptr<AstArena> arena;
+
+    void need(size_t size) {
+        if ((size_t)(end - pos) < size) throw std::runtime_error("truncated module cache");
+    }
+
+    void raw(void* data, size_t size) {
+        need(size);
+        std::memcpy(data, pos, size);
+        pos += size;
+    }
+
+    // A count of items that take at least one byte each
+    size_t u32Count() {
+        uint32_t count = u32();
+        need(count);
+        return count;
+    }
+};
+
+//===----------------------------------------------------------------------===//
+// Cache Files
+//===----------------------------------------------------------------------===//
+
+std::unique_ptr<ProgramAST> ModuleCache::parse(const std::string& path, const std::string& source) {
+    std::string file = enabled ? cachePath(path) : "";
+    uint64_t hash = 0;
+    if (!file.empty()) {
+        hash = hashSource(source);
+        if (auto cached = load(file, source, hash)) {
+            cached->path = path;
+            return cached;
+        }
+    }
+
+    Lexer lexer(source);
+    std::vector<Token> tokens = lexer.tokenize();
+    Parser parser(tokens);
+    auto program = parser.parse();
+    program->path = path;
+    if (!file.empty() && !lexer.hadErrors() && !parser.hadErrors()) {
+        store(file, source, hash, *program);
+    }
+    return program;
+}
+
+std::string ModuleCache::cachePath(const std::string& path) {
+    if (path.empty()) return "";
+    const char* dir = std::getenv("OMNI_CACHE_DIR");
+    if (!dir || !*dir) return path + "c";
+
+    std::error_code error;
+    std::string full = std::filesystem::absolute(path, error).lexically_normal().string();
+    if (error) return "";
+    char name[24];
+    std::snprintf(name, sizeof name, "%016llx", (unsigned long long)hashSource(full));
+    return (std::filesystem::path(dir) / (std::string(name) + ".omnic")).string();
+}
+
+// 64-bit FNV-1a
+uint64_t ModuleCache::hashSource(std::string_view source) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : source) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::unique_ptr<ProgramAST> ModuleCache::load(const std::string& file, const std::string& source, uint64_t hash) {
+    std::ifstream in(file, std::ios::binary | std::ios::ate);
+    if (!in.is_open()) return nullptr;
+    std::string data((size_t)in.tellg(), '\0');
+    in.seekg(0);
+    if (!in.read(data.data(), (std::streamsize)data.size())) return nullptr;
+
+    try {
+        AstReader reader(data.data(), data.size(), std::make_shared<AstArena>());
+        char magic[sizeof kMagic];
+        for (char& c : magic) c = (char)reader.u8();
+        if (std::memcmp(magic, kMagic, sizeof kMagic) != 0) return nullptr;
+        if (reader.u32() != kFormatVersion) return nullptr;
+        if (reader.u32() != kByteOrder) return nullptr;
+        if ((uint64_t)reader.i64() != (uint64_t)source.size()) return nullptr;
+        if ((uint64_t)reader.i64() != hash) return nullptr;
+        if ((uint64_t)reader.i64() != hashSource(reader.rest())) return nullptr;
+        auto program = reader.program();
+        return reader.atEnd() ? std::move(program) : nullptr;
+    } catch (const std::exception&) {
+        return nullptr;
+    }
+}
+
+// Written to a temporary file that is then renamed over the cache, so a
+// concurrent run never reads half a file. A cache that cannot be written
+// (read-only directory, full disk) is skipped.
+void ModuleCache::store(const std::string& file, const std::string& source, uint64_t hash, const ProgramAST& program) {
+    AstWriter body;
+    body.program(program);
+
+    AstWriter writer;
+    for (char c : kMagic) writer.u8((uint8_t)c);
+    writer.u32(kFormatVersion);
+    writer.u32(kByteOrder);
+    writer.i64((long long)source.size());
+    writer.i64((long long)hash);
+    writer.i64((long long)hashSource(body.out));    // Catches a damaged file
+    writer.out += body.out;
+
+    std::string temp = file + ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return;
+        out.write(writer.out.data(), (std::streamsize)writer.out.size());
+        if (!out) {
+            out.close();
+            std::remove(temp.c_str());
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temp, file, error);
+    if (error) std::remove(temp.c_str());
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <memory>
+#include <cstdint>
+#include "AST.h"
+
+// Parsed programs saved on disk, so running or importing a file that has
+// not changed skips lexing and parsing.
+//
+// The cache for dir/name.omni is dir/name.omnic, or, when OMNI_CACHE_DIR
+// is set, a file in that directory named after the source's full path. It
+// holds the AST as the parser built it, before any pass has run, behind a
+// header with the format version, the host byte order, the size and hash
+// of the source text, and a hash of the AST data. A cache that does not
+// match on every one of those is ignored and rewritten. Programs with
+// parse errors are never cached, so their errors are reported on every run.
+class ModuleCache {
+public:
+    static inline bool enabled = true;      // Cleared by --no-cache
+
+    // The program in `source`, read from `path`: loaded from its cache
+    // when that is still valid, otherwise parsed and cached
+    static std::unique_ptr<ProgramAST> parse(const std::string& path, const std::string& source);
+
+private:
+    // Bump on any change to what a cache holds: the encoding here, the AST
+    // node kinds or fields, or what the lexer and parser build from a given
+    // source. Nothing else notices such a change, so old caches would load.
+    static constexpr uint32_t kFormatVersion = 2;
+
+    static std::string cachePath(const std::string& path);
+    static uint64_t hashSource(std::string_view source);
+    static std::unique_ptr<ProgramAST> load(const std::string& file, const std::string& source, uint64_t hash);
+    static void store(const std::string& file, const std::string& source, uint64_t hash, const ProgramAST& program);
+};
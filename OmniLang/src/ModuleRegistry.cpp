@@ -0,0 +1,72 @@
+#include "ModuleRegistry.h"
+#include "ModuleCache.h"
+#include "Resolver.h"
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+#ifdef _WIN32
+static const char kPathSeparator = ';';
+#else
+static const char kPathSeparator = ':';
+#endif
+
+// Directories searched for imports of `fromFile`, in order
+static std::vector<fs::path> searchPath(const std::string& fromFile) {
+    std::vector<fs::path> dirs;
+    if (!fromFile.empty()) dirs.push_back(fs::path(fromFile).parent_path());
+    dirs.emplace_back();    // Working directory
+    if (const char* env = std::getenv("OMNI_PATH")) {
+        std::string list = env;
+        size_t start = 0;
+        while (start <= list.size()) {
+            size_t end = list.find(kPathSeparator, start);
+            if (end == std::string::npos) end = list.size();
+            if (end > start) dirs.emplace_back(list.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+    return dirs;
+}
+
+std::string ModuleRegistry::locate(const std::string& name, const std::string& fromFile) {
+    std::vector<fs::path> names{fs::path(name)};
+    if (!names[0].has_extension()) names.emplace_back(name + ".omni");
+
+    std::error_code error;
+    for (const fs::path& dir : searchPath(fromFile)) {
+        for (const fs::path& file : names) {
+            fs::path candidate = file.is_absolute() ? file : dir / file;
+            if (!fs::is_regular_file(candidate, error)) continue;
+            fs::path canonical = fs::canonical(candidate, error);
+            if (!error) return canonical.string();
+        }
+    }
+    return "";
+}
+
+ProgramAST* ModuleRegistry::load(const std::string& path) {
+    std::error_code error;
+    auto mtime = fs::last_write_time(path, error);
+    if (error) return nullptr;
+
+    auto it = modules.find(path);
+    if (it != modules.end() && it->second.mtime == mtime) return it->second.program.get();
+
+    std::ifstream file(path);
+    if (!file.is_open()) return nullptr;
+    std::stringstream buf;
+    buf << file.rdbuf();
+
+    auto program = ModuleCache::parse(path, buf.str());
+    Resolver resolver;
+    resolver.resolve(*program);
+
+    Module& module = modules[path];
+    if (module.program) replaced.push_back(std::move(module.program));
+    module.mtime = mtime;
+    module.program = std::move(program);
+    return module.program.get();
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include "AST.h"
+
+// Every module imported in this process, parsed and resolved once and then
+// shared by each engine that imports it.
+//
+// A module is found next to the file importing it, then in the working
+// directory, then in each directory listed in OMNI_PATH; `import utils`
+// also matches utils.omni. Modules are keyed by canonical path, so one file
+// imported under two spellings is loaded once, and are reloaded when the
+// file's modification time changes. Replaced modules are kept, since
+// engines that imported them may still be running their code.
+//
+// Engines only read the shared AST, apart from inline caches that are valid
+// for every engine and the class links each engine redoes when it imports.
+class ModuleRegistry {
+public:
+    // Canonical path of the module `name` imported by `fromFile` (empty for
+    // code not read from a file), or "" if there is none
+    static std::string locate(const std::string& name, const std::string& fromFile);
+
+    // The module at a path from locate(), or null if it cannot be read
+    static ProgramAST* load(const std::string& path);
+
+private:
+    struct Module {
+        std::filesystem::file_time_type mtime;
+        std::unique_ptr<ProgramAST> program;
+    };
+
+    static inline std::unordered_map<std::string, Module> modules;
+    static inline std::vector<std::unique_ptr<ProgramAST>> replaced;
+};
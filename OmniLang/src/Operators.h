@@ -0,0 +1,362 @@
+#pragma once
+#include <string>
+#include <climits>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include "AST.h"
+#include "StdLib.h"
+
+//===----------------------------------------------------------------------===//
+// Operator Semantics
+//===----------------------------------------------------------------------===//
+
+// Arithmetic, comparison and logical operators shared by the tree-walking
+// Interpreter and the bytecode VM, so both engines produce identical results.
+//
+// Each operator checks the common type pairs first: int op int stays an
+// int64 (falling back to double only on overflow), strings compare as
+// strings, and arithmetic on anything else goes through toDouble() as
+// before. Comparisons never convert: values of different types are not
+// equal, and only numbers and strings can be ordered.
+class Operators {
+public:
+    static bool bothInt(const RuntimeValue& left, const RuntimeValue& right) {
+        return left.type == ValueType::Int && right.type == ValueType::Int;
+    }
+
+    static bool bothString(const RuntimeValue& left, const RuntimeValue& right) {
+        return left.type == ValueType::String && right.type == ValueType::String;
+    }
+
+    static bool bothNumber(const RuntimeValue& left, const RuntimeValue& right) {
+        auto isNumber = [](const RuntimeValue& v) { return v.type == ValueType::Int || v.type == ValueType::Double; };
+        return isNumber(left) && isNumber(right);
+    }
+
+    // Overflow-checked int64 arithmetic; false if the result does not fit
+    static bool checkedAdd(long long a, long long b, long long& out) {
+#if defined(__GNUC__) || defined(__clang__)
+        return !__builtin_add_overflow(a, b, &out);
+#else
+        if ((b > 0 && a > LLONG_MAX - b) || (b < 0 && a < LLONG_MIN - b)) return false;
+        out = a + b;
+        return true;
+#endif
+    }
+
+    static bool checkedSub(long long a, long long b, long long& out) {
+#if defined(__GNUC__) || defined(__clang__)
+        return !__builtin_sub_overflow(a, b, &out);
+#else
+        if ((b < 0 && a > LLONG_MAX + b) || (b > 0 && a < LLONG_MIN + b)) return false;
+        out = a - b;
+        return true;
+#endif
+    }
+
+    static bool checkedMul(long long a, long long b, long long& out) {
+#if defined(__GNUC__) || defined(__clang__)
+        return !__builtin_mul_overflow(a, b, &out);
+#else
+        if (a == 0 || b == 0) { out = 0; return true; }
+        if (a == -1) { if (b == LLONG_MIN) return false; out = -b; return true; }
+        long long r = (long long)((unsigned long long)a * (unsigned long long)b);
+        if (r / a != b) return false;
+        out = r;
+        return true;
+#endif
+    }
+
+    static RuntimeValue add(const RuntimeValue& left, const RuntimeValue& right) {
+        if (bothInt(left, right)) {
+            long long result;
+            if (checkedAdd(left.intVal, right.intVal, result)) return RuntimeValue(result);
+            return RuntimeValue((double)left.intVal + (double)right.intVal);
+        }
+        // String concatenation
+        if (left.type == ValueType::String || right.type == ValueType::String) {
+            return RuntimeValue(left.toString() + right.toString());
+        }
+        return RuntimeValue(left.toDouble() + right.toDouble());
+    }
+
+    // left + right for an engine that owns left and drops it afterwards. A
+    // string nothing else refers to is appended to in place, so building
+    // one with s = s + x costs amortized O(1) per append, not a copy of s.
+    static RuntimeValue addTo(RuntimeValue& left, const RuntimeValue& right) {
+        if (left.type == ValueType::String && left.cell->refCount == 1) {
+            auto* s = static_cast<StringCell*>(left.cell);
+            if (right.type == ValueType::String) s->value += right.str();
+            else s->value += right.toString();
+            s->forgetSymbol();
+            return std::move(left);
+        }
+        return add(left, right);
+    }
+
+    // parts[0] + parts[1] + ... where the result is known to be a string: the
+    // text is sized once and joined into one buffer. As with addTo, a first
+    // part nothing else refers to is appended to in place.
+    static RuntimeValue concat(RuntimeValue* parts, size_t count) {
+        size_t length = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (parts[i].type == ValueType::String) length += parts[i].str().size();
+            else if (parts[i].type == ValueType::Int) length += 20;
+        }
+        if (count > 0 && parts[0].type == ValueType::String && parts[0].cell->refCount == 1) {
+            auto* s = static_cast<StringCell*>(parts[0].cell);
+            // Keep growth geometric: a loop appending to s reserves each pass
+            if (length > s->value.capacity()) s->value.reserve(std::max(length, 2 * s->value.capacity()));
+            for (size_t i = 1; i < count; i++) appendText(s->value, parts[i]);
+            s->forgetSymbol();
+            return std::move(parts[0]);
+        }
+        std::string text;
+        text.reserve(length);
+        for (size_t i = 0; i < count; i++) appendText(text, parts[i]);
+        return RuntimeValue(std::move(text));
+    }
+
+    // Same text as toString(), written straight into out
+    static void appendText(std::string& out, const RuntimeValue& val) {
+        if (val.type == ValueType::String) {
+            out += val.str();
+        } else if (val.type == ValueType::Int) {
+            char digits[24];
+            auto end = std::to_chars(digits, digits + sizeof(digits), val.intVal).ptr;
+            out.append(digits, end);
+        } else {
+            out += val.toString();
+        }
+    }
+
+    // Text of val under an f-string {value:spec}. Without a type, numbers
+    // keep their usual text unless a precision asks for fixed point, and
+    // strings are cut to the precision.
+    static void appendFormatted(std::string& out, const RuntimeValue& val, const FormatSpec& spec, int line) {
+        bool numeric = val.type == ValueType::Int || val.type == ValueType::Double;
+        char type = spec.type;
+        if (!type && numeric && spec.precision >= 0) type = 'f';
+        if (type && type != 's' && !numeric) {
+            throw OmniException(std::string("Format spec '") + type + "' needs a number, got " + val.toString(), line);
+        }
+
+        std::string sign, body;
+        if (numeric && type != 's') {
+            double d = val.toDouble();
+            bool negative = val.type == ValueType::Int ? val.intVal < 0 : std::signbit(d);
+            if (negative) sign = "-";
+            else if (spec.plus) sign = "+";
+            char buf[64];
+            switch (type) {
+            case 'd':
+            case 'x': {
+                long long n = val.toInt();
+                unsigned long long mag = n < 0 ? 0ULL - (unsigned long long)n : (unsigned long long)n;
+                auto end = std::to_chars(buf, buf + sizeof(buf), mag, type == 'x' ? 16 : 10).ptr;
+                body.assign(buf, end);
+                break;
+            }
+            case 'f':
+            case 'e':
+            case '%': {
+                int precision = spec.precision >= 0 ? spec.precision : 6;
+                double mag = std::fabs(type == '%' ? d * 100 : d);
+                int len = std::snprintf(buf, sizeof(buf), type == 'e' ? "%.*e" : "%.*f", precision, mag);
+                if (len < 0 || len >= (int)sizeof(buf)) body = std::to_string(mag);
+                else body.assign(buf, len);
+                if (type == '%') body += '%';
+                break;
+            }
+            default:
+                body = val.toString();
+                if (negative) body.erase(0, 1);
+            }
+            if (spec.grouping && type != 'x' && type != 'e') {
+                size_t digits = body.find_first_not_of("0123456789");
+                if (digits == std::string::npos) digits = body.length();
+                for (size_t at = digits; at > 3; at -= 3) body.insert(at - 3, 1, ',');
+            }
+        } else {
+            body = val.toString();
+            if (spec.precision >= 0 && body.length() > (size_t)spec.precision) body.resize(spec.precision);
+        }
+
+        size_t length = sign.length() + body.length();
+        size_t pad = spec.width > (int)length ? spec.width - length : 0;
+        if (spec.zeroPad && !spec.align && numeric) {
+            out += sign;
+            out.append(pad, '0');
+            out += body;
+            return;
+        }
+        char align = spec.align ? spec.align : (numeric ? '>' : '<');
+        size_t before = align == '>' ? pad : align == '^' ? pad / 2 : 0;
+        out.append(before, spec.fill);
+        out += sign;
+        out += body;
+        out.append(pad - before, spec.fill);
+    }
+
+    static RuntimeValue sub(const RuntimeValue& left, const RuntimeValue& right) {
+        if (bothInt(left, right)) {
+            long long result;
+            if (checkedSub(left.intVal, right.intVal, result)) return RuntimeValue(result);
+            return RuntimeValue((double)left.intVal - (double)right.intVal);
+        }
+        return RuntimeValue(left.toDouble() - right.toDouble());
+    }
+
+    static RuntimeValue mul(const RuntimeValue& left, const RuntimeValue& right) {
+        if (bothInt(left, right)) {
+            long long result;
+            if (checkedMul(left.intVal, right.intVal, result)) return RuntimeValue(result);
+            return RuntimeValue((double)left.intVal * (double)right.intVal);
+        }
+        return RuntimeValue(left.toDouble() * right.toDouble());
+    }
+
+    // Division always yields a double: 7 / 2 is 3.5
+    static RuntimeValue div(const RuntimeValue& left, const RuntimeValue& right) {
+        double divisor = right.toDouble();
+        if (divisor == 0) return RuntimeValue(0.0);
+        return RuntimeValue(left.toDouble() / divisor);
+    }
+
+    // Integer remainder; like division, a zero divisor yields 0
+    static RuntimeValue mod(const RuntimeValue& left, const RuntimeValue& right) {
+        long long a = left.toInt();
+        long long b = right.toInt();
+        if (b == 0 || b == -1) return RuntimeValue(0LL);
+        return RuntimeValue(a % b);
+    }
+
+    // Int and double compare by value; otherwise values of different types
+    // are never equal, and arrays, maps, objects, lambdas and ranges are
+    // equal only to themselves
+    static bool equals(const RuntimeValue& left, const RuntimeValue& right) {
+        if (bothInt(left, right)) return left.intVal == right.intVal;
+        if (bothString(left, right)) return left.str() == right.str();
+        if (bothNumber(left, right)) return left.toDouble() == right.toDouble();
+        if (left.type != right.type) return false;
+        switch (left.type) {
+        case ValueType::Null: return true;
+        case ValueType::Bool: return left.boolVal == right.boolVal;
+        default:              return left.cell == right.cell;
+        }
+    }
+
+    static RuntimeValue equal(const RuntimeValue& left, const RuntimeValue& right) {
+        return RuntimeValue(equals(left, right));
+    }
+
+    static RuntimeValue notEqual(const RuntimeValue& left, const RuntimeValue& right) {
+        return RuntimeValue(!equals(left, right));
+    }
+
+    // Ints are compared inline; order() handles every other pair, so the
+    // operators stay small enough to inline into the engines
+    static RuntimeValue less(const RuntimeValue& left, const RuntimeValue& right, int line) {
+        if (bothInt(left, right)) return RuntimeValue(left.intVal < right.intVal);
+        return RuntimeValue(order(BinaryOp::Less, left, right, line));
+    }
+
+    static RuntimeValue greater(const RuntimeValue& left, const RuntimeValue& right, int line) {
+        if (bothInt(left, right)) return RuntimeValue(left.intVal > right.intVal);
+        return RuntimeValue(order(BinaryOp::Greater, left, right, line));
+    }
+
+    static RuntimeValue lessEqual(const RuntimeValue& left, const RuntimeValue& right, int line) {
+        if (bothInt(left, right)) return RuntimeValue(left.intVal <= right.intVal);
+        return RuntimeValue(order(BinaryOp::LessEqual, left, right, line));
+    }
+
+    static RuntimeValue greaterEqual(const RuntimeValue& left, const RuntimeValue& right, int line) {
+        if (bothInt(left, right)) return RuntimeValue(left.intVal >= right.intVal);
+        return RuntimeValue(order(BinaryOp::GreaterEqual, left, right, line));
+    }
+
+    // Strings compare as strings and numbers as doubles; no other pair has
+    // an order
+    [[gnu::noinline]] static bool order(BinaryOp op, const RuntimeValue& left, const RuntimeValue& right, int line) {
+        if (bothString(left, right)) return holds(op, left.str().compare(right.str()), 0);
+        if (bothNumber(left, right)) return holds(op, left.toDouble(), right.toDouble());
+        const char* symbol = op == BinaryOp::Less ? "<" : op == BinaryOp::Greater ? ">" :
+                             op == BinaryOp::LessEqual ? "<=" : ">=";
+        throw OmniException(std::string("Cannot compare ") + StdLib::typeName(left.type) + " and " +
+                            StdLib::typeName(right.type) + " with " + symbol, line);
+    }
+
+    template <typename T>
+    static bool holds(BinaryOp op, T a, T b) {
+        switch (op) {
+        case BinaryOp::Less:      return a < b;
+        case BinaryOp::Greater:   return a > b;
+        case BinaryOp::LessEqual: return a <= b;
+        default:                  return a >= b;
+        }
+    }
+
+    static RuntimeValue logicalAnd(const RuntimeValue& left, const RuntimeValue& right) {
+        return RuntimeValue(left.toBool() && right.toBool());
+    }
+
+    static RuntimeValue logicalOr(const RuntimeValue& left, const RuntimeValue& right) {
+        return RuntimeValue(left.toBool() || right.toBool());
+    }
+
+    // line is reported by comparisons of values that have no order
+    static RuntimeValue binary(BinaryOp op, const RuntimeValue& left, const RuntimeValue& right, int line) {
+        switch (op) {
+        case BinaryOp::Add:          return add(left, right);
+        case BinaryOp::Sub:          return sub(left, right);
+        case BinaryOp::Mul:          return mul(left, right);
+        case BinaryOp::Div:          return div(left, right);
+        case BinaryOp::Mod:          return mod(left, right);
+        case BinaryOp::Equal:        return equal(left, right);
+        case BinaryOp::NotEqual:     return notEqual(left, right);
+        case BinaryOp::Less:         return less(left, right, line);
+        case BinaryOp::Greater:      return greater(left, right, line);
+        case BinaryOp::LessEqual:    return lessEqual(left, right, line);
+        case BinaryOp::GreaterEqual: return greaterEqual(left, right, line);
+        case BinaryOp::And:          return logicalAnd(left, right);
+        case BinaryOp::Or:           return logicalOr(left, right);
+        }
+        return RuntimeValue();
+    }
+
+    // Target of container[index] = value: an existing array element, or a
+    // map/object entry (created if missing). Anything else is an error.
+    static RuntimeValue& element(RuntimeValue& container, const RuntimeValue& index, int line) {
+        if (container.type == ValueType::Object) {
+            return container.field(index.toSymbol());
+        }
+        if (container.type != ValueType::Array) {
+            throw OmniException("Cannot assign to an element of a non-array value", line);
+        }
+        if (index.type != ValueType::Int && index.type != ValueType::Double) {
+            throw OmniException("Array index must be a number", line);
+        }
+        auto& items = container.mutableArray();
+        long long i = index.toInt();
+        if (i < 0 || i >= (long long)items.size()) {
+            throw OmniException("Index " + std::to_string(i) + " out of range for array of size " +
+                                std::to_string(items.size()), line);
+        }
+        return items[i];
+    }
+
+    static RuntimeValue logicalNot(const RuntimeValue& val) {
+        return RuntimeValue(!val.toBool());
+    }
+
+    static RuntimeValue negate(const RuntimeValue& val) {
+        if (val.type == ValueType::Int && val.intVal != LLONG_MIN) return RuntimeValue(-val.intVal);
+        return RuntimeValue(-val.toDouble());
+    }
+
+    static RuntimeValue unary(UnaryOp op, const RuntimeValue& val) {
+        return op == UnaryOp::Not ? logicalNot(val) : negate(val);
+    }
+};
@@ -0,0 +1,483 @@
+#include "Optimizer.h"
+#include "Operators.h"
+
+//===----------------------------------------------------------------------===//
+// Entry Points
+//===----------------------------------------------------------------------===//
+
+void Optimizer::optimize(ProgramAST& program) {
+    arena = program.arena.get();
+    for (auto& cls : program.classes) {
+        for (auto& field : cls->fields) {
+            if (field.initializer) optimizeExpr(field.initializer);
+            settle();
+        }
+        if (cls->constructor) optimizeFunction(cls->constructor.get());
+        for (auto& method : cls->methods) {
+            optimizeFunction(method.get());
+        }
+    }
+    for (auto& func : program.functions) {
+        optimizeFunction(func.get());
+    }
+}
+
+void Optimizer::printReport(std::ostream& out) const {
+    int counts[4] = {0, 0, 0, 0};
+    out << "=== Optimization Report ===" << std::endl;
+    for (auto& n : notes) {
+        counts[n.kind]++;
+        out << "  line " << n.line << ": " << n.text << std::endl;
+    }
+    out << counts[Note::Expr] << " expression(s) folded, "
+        << counts[Note::Call] << " builtin call(s) folded, "
+        << counts[Note::Branch] << " branch(es) removed, "
+        << counts[Note::Unreachable] << " unreachable block(s) removed" << std::endl;
+}
+
+void Optimizer::optimizeFunction(FunctionAST* func) {
+    optimizeBlock(func->body, true);
+}
+
+//===----------------------------------------------------------------------===//
+// Statements
+//===----------------------------------------------------------------------===//
+
+// A function's last statement supplies its implicit result, so in a function
+// body it is never removed or inlined.
+void Optimizer::optimizeBlock(std::vector<StmtPtr>& body, bool functionBody) {
+    std::vector<StmtPtr> out;
+    for (size_t i = 0; i < body.size(); i++) {
+        StmtPtr& stmt = body[i];
+        if (!stmt) {
+            out.push_back(std::move(stmt));
+            continue;
+        }
+        optimizeStmt(stmt.get());
+        settle();
+        bool last = functionBody && i + 1 == body.size();
+
+        if (stmt->kind == StmtKind::If && simplifyIf(out, stmt, last)) continue;
+
+        if (stmt->kind == StmtKind::While && !last) {
+            RuntimeValue cond;
+            auto* whileStmt = static_cast<WhileStmtAST*>(stmt.get());
+            if (literalValue(whileStmt->condition.get(), cond) && !cond.toBool()) {
+                note(Note::Unreachable, stmt->line, "removed loop whose condition is always false");
+                continue;
+            }
+        }
+
+        StmtKind kind = stmt->kind;
+        int line = stmt->line;
+        out.push_back(std::move(stmt));
+        bool terminates = kind == StmtKind::Return || kind == StmtKind::Break ||
+                          kind == StmtKind::Continue || kind == StmtKind::Throw;
+        if (terminates && i + 1 < body.size()) {
+            note(Note::Unreachable, line, "removed " + std::to_string(body.size() - i - 1) +
+                 " unreachable statement(s)");
+            break;
+        }
+    }
+    body = std::move(out);
+}
+
+void Optimizer::optimizeStmt(StmtAST* stmt) {
+    if (stmt->line > 0) currentLine = stmt->line;
+
+    switch (stmt->kind) {
+    case StmtKind::Expr:
+        optimizeExpr(static_cast<ExprStmtAST*>(stmt)->expr);
+        return;
+
+    case StmtKind::Return:
+        optimizeExpr(static_cast<ReturnStmtAST*>(stmt)->value);
+        return;
+
+    case StmtKind::VarDecl:
+        optimizeExpr(static_cast<VarDeclStmtAST*>(stmt)->initializer);
+        return;
+
+    case StmtKind::Assign: {
+        auto* assign = static_cast<AssignStmtAST*>(stmt);
+        optimizeExpr(assign->value);
+        optimizeExpr(assign->target);
+        return;
+    }
+
+    case StmtKind::If: {
+        auto* ifStmt = static_cast<IfStmtAST*>(stmt);
+        optimizeExpr(ifStmt->condition);
+        optimizeBlock(ifStmt->thenBody, false);
+        optimizeBlock(ifStmt->elseBody, false);
+        return;
+    }
+
+    case StmtKind::While: {
+        auto* whileStmt = static_cast<WhileStmtAST*>(stmt);
+        optimizeExpr(whileStmt->condition);
+        optimizeBlock(whileStmt->body, false);
+        return;
+    }
+
+    case StmtKind::For: {
+        auto* forStmt = static_cast<ForStmtAST*>(stmt);
+        optimizeExpr(forStmt->iterable);
+        optimizeBlock(forStmt->body, false);
+        return;
+    }
+
+    case StmtKind::TryCatch: {
+        auto* tryStmt = static_cast<TryCatchStmtAST*>(stmt);
+        optimizeBlock(tryStmt->tryBody, false);
+        optimizeBlock(tryStmt->catchBody, false);
+        optimizeBlock(tryStmt->finallyBody, false);
+        return;
+    }
+
+    case StmtKind::Throw:
+        optimizeExpr(static_cast<ThrowStmtAST*>(stmt)->exception);
+        return;
+
+    case StmtKind::Break:
+    case StmtKind::Continue:
+        return;
+    }
+}
+
+// An if on a constant condition loses its dead branch. The live branch is
+// inlined into the enclosing block unless that would change which block
+// its variables belong to; then the if stays, testing a literal true.
+bool Optimizer::simplifyIf(std::vector<StmtPtr>& out, StmtPtr& stmt, bool keepAsLast) {
+    auto* ifStmt = static_cast<IfStmtAST*>(stmt.get());
+    RuntimeValue cond;
+    if (!literalValue(ifStmt->condition.get(), cond)) return false;
+
+    bool taken = cond.toBool();
+    std::vector<StmtPtr>& live = taken ? ifStmt->thenBody : ifStmt->elseBody;
+    std::vector<StmtPtr>& dead = taken ? ifStmt->elseBody : ifStmt->thenBody;
+    const char* deadName = taken ? "'else'" : "'if'";
+
+    if (!keepAsLast && !declaresVariables(live)) {
+        note(Note::Branch, stmt->line, dead.empty()
+             ? "removed test of constant condition"
+             : std::string("removed unreachable ") + deadName + " branch and inlined the other");
+        for (auto& s : live) out.push_back(std::move(s));
+        return true;
+    }
+    if (dead.empty()) return false;
+
+    note(Note::Branch, stmt->line, std::string("removed unreachable ") + deadName + " branch");
+    std::vector<StmtPtr> body = std::move(live);
+    ifStmt->thenBody = std::move(body);
+    ifStmt->elseBody.clear();
+    ifStmt->condition = makeLiteral(RuntimeValue(true), ifStmt->condition->line);
+    out.push_back(std::move(stmt));
+    return true;
+}
+
+bool Optimizer::declaresVariables(const std::vector<StmtPtr>& body) {
+    for (auto& s : body) {
+        if (s && s->kind == StmtKind::VarDecl) return true;
+    }
+    return false;
+}
+
+//===----------------------------------------------------------------------===//
+// Expressions
+//===----------------------------------------------------------------------===//
+
+void Optimizer::optimizeExpr(ExprPtr& expr) {
+    if (!expr) return;
+    if (expr->line > 0) currentLine = expr->line;
+
+    switch (expr->kind) {
+    case ExprKind::Number:
+    case ExprKind::String:
+    case ExprKind::Variable:
+    case ExprKind::Self:
+        return;
+
+    case ExprKind::Lambda:
+        optimizeExpr(static_cast<LambdaExprAST*>(expr.get())->body);
+        return;
+
+    case ExprKind::FString:
+        for (auto& part : static_cast<FStringExprAST*>(expr.get())->parts) {
+            if (part.expr) optimizeExpr(part.expr);
+        }
+        return;
+
+    case ExprKind::Binary: {
+        auto* binary = static_cast<BinaryExprAST*>(expr.get());
+        optimizeExpr(binary->lhs);
+        optimizeExpr(binary->rhs);
+        if (!foldBinary(expr)) fuseConcat(expr);
+        return;
+    }
+
+    case ExprKind::Unary:
+        optimizeExpr(static_cast<UnaryExprAST*>(expr.get())->operand);
+        foldUnary(expr);
+        return;
+
+    case ExprKind::Call: {
+        auto* call = static_cast<CallExprAST*>(expr.get());
+        optimizeArgs(call->args);
+        std::vector<RuntimeValue> args;
+        if (collectLiterals(call->args, args)) foldCall(expr, call->callee, args, operands(call->args));
+        return;
+    }
+
+    case ExprKind::MethodCall: {
+        auto* methodCall = static_cast<MethodCallExprAST*>(expr.get());
+        optimizeArgs(methodCall->args);
+
+        // Module call (Math.sqrt, ...): the engines never evaluate the object
+        if (methodCall->object->kind == ExprKind::Variable) {
+            auto* var = static_cast<VariableExprAST*>(methodCall->object.get());
+            std::string fullName = var->name + "." + methodCall->methodName;
+            if (StdLib::hasFunction(fullName)) {
+                std::vector<RuntimeValue> args;
+                if (collectLiterals(methodCall->args, args)) foldCall(expr, fullName, args, operands(methodCall->args));
+                return;
+            }
+        }
+
+        // Method on a string literal: "abc".toUpperCase()
+        optimizeExpr(methodCall->object);
+        RuntimeValue receiver;
+        if (!literalValue(methodCall->object.get(), receiver) || receiver.type != ValueType::String) return;
+        std::vector<RuntimeValue> args = {receiver};
+        if (collectLiterals(methodCall->args, args)) {
+            std::vector<ExprAST*> parts = operands(methodCall->args);
+            parts.push_back(methodCall->object.get());
+            foldCall(expr, "String." + methodCall->methodName, args, parts);
+        }
+        return;
+    }
+
+    case ExprKind::MemberAccess:
+        optimizeExpr(static_cast<MemberAccessExprAST*>(expr.get())->object);
+        return;
+
+    case ExprKind::New:
+        optimizeArgs(static_cast<NewExprAST*>(expr.get())->args);
+        return;
+
+    case ExprKind::Array:
+        optimizeArgs(static_cast<ArrayExprAST*>(expr.get())->elements);
+        return;
+
+    case ExprKind::Index: {
+        auto* idx = static_cast<IndexExprAST*>(expr.get());
+        optimizeExpr(idx->array);
+        optimizeExpr(idx->index);
+        return;
+    }
+
+    case ExprKind::Concat:
+        optimizeArgs(static_cast<ConcatExprAST*>(expr.get())->parts);
+        return;
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Concatenation
+//===----------------------------------------------------------------------===//
+
+// Whether the expression always evaluates to a string
+static bool isStringValued(const ExprAST* expr) {
+    return expr->kind == ExprKind::String || expr->kind == ExprKind::FString || expr->kind == ExprKind::Concat;
+}
+
+// Once one operand of + is a string, the sum is that text joined with the
+// other's toString(), and so is every + applied to it later. Such chains
+// become one ConcatExprAST, flattened as they are built bottom-up; runs of
+// literals are joined ahead of time.
+void Optimizer::fuseConcat(ExprPtr& expr) {
+    auto* binary = static_cast<BinaryExprAST*>(expr.get());
+    if (binary->op != BinaryOp::Add) return;
+    if (!isStringValued(binary->lhs.get()) && !isStringValued(binary->rhs.get())) return;
+
+    std::vector<ExprPtr> parts;
+    for (ExprPtr* side : {&binary->lhs, &binary->rhs}) {
+        if ((*side)->kind == ExprKind::Concat) {
+            for (auto& part : static_cast<ConcatExprAST*>(side->get())->parts) {
+                appendPart(parts, std::move(part));
+            }
+        } else {
+            appendPart(parts, std::move(*side));
+        }
+    }
+    int line = expr->line;
+    expr = arena->make<ConcatExprAST>(std::move(parts));
+    expr->line = line;
+}
+
+void Optimizer::appendPart(std::vector<ExprPtr>& parts, ExprPtr part) {
+    if (part->kind == ExprKind::String && !parts.empty() && parts.back()->kind == ExprKind::String) {
+        auto* last = static_cast<StringExprAST*>(parts.back().get());
+        std::string joined = last->value + static_cast<StringExprAST*>(part.get())->value;
+        int line = last->line;
+        parts.back() = arena->make<StringExprAST>(joined);
+        parts.back()->line = line;
+        return;
+    }
+    parts.push_back(std::move(part));
+}
+
+void Optimizer::optimizeArgs(std::vector<ExprPtr>& args) {
+    for (auto& arg : args) {
+        optimizeExpr(arg);
+    }
+}
+
+std::vector<ExprAST*> Optimizer::operands(const std::vector<ExprPtr>& exprs) {
+    std::vector<ExprAST*> result;
+    for (auto& e : exprs) result.push_back(e.get());
+    return result;
+}
+
+bool Optimizer::collectLiterals(const std::vector<ExprPtr>& exprs, std::vector<RuntimeValue>& values) {
+    for (auto& e : exprs) {
+        RuntimeValue v;
+        if (!literalValue(e.get(), v)) return false;
+        values.push_back(v);
+    }
+    return true;
+}
+
+//===----------------------------------------------------------------------===//
+// Literals
+//===----------------------------------------------------------------------===//
+
+// The value of a literal node, evaluated the way the engines would
+bool Optimizer::literalValue(ExprAST* expr, RuntimeValue& out) {
+    if (!expr) return false;
+    switch (expr->kind) {
+    case ExprKind::Number: {
+        auto* num = static_cast<NumberExprAST*>(expr);
+        out = num->isInt ? RuntimeValue(num->intValue) : RuntimeValue(num->value);
+        return true;
+    }
+    case ExprKind::String:
+        out = RuntimeValue::literal(static_cast<StringExprAST*>(expr)->symbol);
+        return true;
+    case ExprKind::Variable: {
+        const std::string& name = static_cast<VariableExprAST*>(expr)->name;
+        if (name == "true") { out = RuntimeValue(true); return true; }
+        if (name == "false") { out = RuntimeValue(false); return true; }
+        if (name == "null") { out = RuntimeValue(); return true; }
+        return false;
+    }
+    default:
+        return false;
+    }
+}
+
+// A node evaluating to `value`, or null if it has no literal form
+ExprPtr Optimizer::makeLiteral(const RuntimeValue& value, int line) {
+    ExprPtr lit;
+    switch (value.type) {
+    case ValueType::Int:    lit = arena->make<NumberExprAST>(value.intVal); break;
+    case ValueType::Double: lit = arena->make<NumberExprAST>(value.doubleVal, false); break;
+    case ValueType::String: lit = arena->make<StringExprAST>(value.str()); break;
+    case ValueType::Bool:   lit = arena->make<VariableExprAST>(value.boolVal ? "true" : "false"); break;
+    case ValueType::Null:   lit = arena->make<VariableExprAST>("null"); break;
+    default: return nullptr;
+    }
+    lit->line = line;
+    return lit;
+}
+
+std::string Optimizer::describe(const RuntimeValue& value) {
+    if (value.type == ValueType::String) return "\"" + value.str() + "\"";
+    return value.toString();
+}
+
+//===----------------------------------------------------------------------===//
+// Folding
+//===----------------------------------------------------------------------===//
+
+bool Optimizer::foldBinary(ExprPtr& expr) {
+    auto* binary = static_cast<BinaryExprAST*>(expr.get());
+    RuntimeValue left, right;
+    if (!literalValue(binary->lhs.get(), left)) return false;
+
+    // A deciding left operand makes the right one irrelevant
+    if (binary->op == BinaryOp::And && !left.toBool()) {
+        return replaceWith(expr, Note::Expr, RuntimeValue(false), "constant expression", {binary->lhs.get()});
+    }
+    if (binary->op == BinaryOp::Or && left.toBool()) {
+        return replaceWith(expr, Note::Expr, RuntimeValue(true), "constant expression", {binary->lhs.get()});
+    }
+
+    if (!literalValue(binary->rhs.get(), right)) return false;
+    RuntimeValue result;
+    try {
+        result = Operators::binary(binary->op, left, right, binary->line);
+    } catch (...) {
+        return false;
+    }
+    return replaceWith(expr, Note::Expr, result, "constant expression", {binary->lhs.get(), binary->rhs.get()});
+}
+
+bool Optimizer::foldUnary(ExprPtr& expr) {
+    auto* unary = static_cast<UnaryExprAST*>(expr.get());
+    RuntimeValue operand;
+    if (!literalValue(unary->operand.get(), operand)) return false;
+    RuntimeValue result;
+    try {
+        result = Operators::unary(unary->op, operand);
+    } catch (...) {
+        return false;
+    }
+    return replaceWith(expr, Note::Expr, result, "constant expression", {unary->operand.get()});
+}
+
+bool Optimizer::foldCall(ExprPtr& expr, const std::string& name, const std::vector<RuntimeValue>& args,
+                         const std::vector<ExprAST*>& operands) {
+    auto& pure = StdLib::getPureFunctions();
+    auto it = pure.find(name);
+    if (it == pure.end() || args.size() < it->second) return false;
+
+    RuntimeValue result;
+    try {
+        result = StdLib::call(name, args);
+    } catch (...) {
+        return false;
+    }
+    return replaceWith(expr, Note::Call, result, name + "()", operands);
+}
+
+bool Optimizer::replaceWith(ExprPtr& expr, Note::Kind kind, const RuntimeValue& value, const std::string& what,
+                            const std::vector<ExprAST*>& operands) {
+    int line = expr->line > 0 ? expr->line : currentLine;
+    ExprPtr lit = makeLiteral(value, line);
+    if (!lit) return false;
+
+    // Operands folded earlier are now part of this constant
+    for (ExprAST* operand : operands) {
+        for (size_t i = 0; i < notes.size(); i++) {
+            if (notes[i].node == operand) {
+                notes.erase(notes.begin() + i);
+                break;
+            }
+        }
+    }
+    ExprAST* node = lit.get();
+    expr = std::move(lit);
+    notes.push_back({kind, line, "folded " + what + " => " + describe(value), node});
+    return true;
+}
+
+void Optimizer::note(Note::Kind kind, int line, const std::string& text) {
+    notes.push_back({kind, line, text, nullptr});
+}
+
+// Folding never crosses a statement, so once one is done its literals are
+// final; forgetting them also keeps removed subtrees from being matched.
+void Optimizer::settle() {
+    for (auto& n : notes) n.node = nullptr;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <ostream>
+#include "AST.h"
+#include "StdLib.h"
+
+// Simplifies a parsed program before it is resolved and run:
+//   - folds operators whose operands are literals (2 * 60 * 60 => 7200)
+//   - evaluates calls to pure builtins on literals (Math.PI(), "a".toUpperCase())
+//   - drops the branch of an if that can never run, and while-false loops
+//   - drops statements after return/break/continue/throw in the same block
+//   - joins a + "x" + b + ... chains into one ConcatExprAST
+//
+// Folding goes through the same Operators and StdLib code the engines use,
+// so results are identical; anything that would raise an error is left for
+// run time.
+class Optimizer {
+public:
+    void optimize(ProgramAST& program);
+    void printReport(std::ostream& out) const;
+
+private:
+    struct Note {
+        enum Kind { Expr, Call, Branch, Unreachable } kind;
+        int line;
+        std::string text;
+        ExprAST* node;      // Folded literal that may still be folded further
+    };
+
+    std::vector<Note> notes;
+    int currentLine = 0;
+    AstArena* arena = nullptr;      // The program's; new nodes go here
+
+    void optimizeFunction(FunctionAST* func);
+    void optimizeBlock(std::vector<StmtPtr>& body, bool functionBody);
+    void optimizeStmt(StmtAST* stmt);
+    bool simplifyIf(std::vector<StmtPtr>& out, StmtPtr& stmt, bool keepAsLast);
+    static bool declaresVariables(const std::vector<StmtPtr>& body);
+
+    void optimizeExpr(ExprPtr& expr);
+    void optimizeArgs(std::vector<ExprPtr>& args);
+    static std::vector<ExprAST*> operands(const std::vector<ExprPtr>& exprs);
+    static bool collectLiterals(const std::vector<ExprPtr>& exprs, std::vector<RuntimeValue>& values);
+
+    // Literals
+    static bool literalValue(ExprAST* expr, RuntimeValue& out);
+    ExprPtr makeLiteral(const RuntimeValue& value, int line);
+    static std::string describe(const RuntimeValue& value);
+
+    // Folding
+    bool foldBinary(ExprPtr& expr);
+    bool foldUnary(ExprPtr& expr);
+    bool foldCall(ExprPtr& expr, const std::string& name, const std::vector<RuntimeValue>& args,
+                  const std::vector<ExprAST*>& operands);
+    void fuseConcat(ExprPtr& expr);
+    void appendPart(std::vector<ExprPtr>& parts, ExprPtr part);
+    bool replaceWith(ExprPtr& expr, Note::Kind kind, const RuntimeValue& value, const std::string& what,
+                     const std::vector<ExprAST*>& operands);
+    void note(Note::Kind kind, int line, const std::string& text);
+    void settle();
+};
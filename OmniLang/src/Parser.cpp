@@ -1,18 +1,24 @@
 #include "Parser.h"
+#include "Lexer.h"
 #include <iostream>
+#include <cstring>
 #include <stdexcept>
 
-Parser::Parser(const std::vector<Token>& toks) : tokens(toks) {}
+Parser::Parser(const std::vector<Token>& toks)
+    : tokens(toks), arena(std::make_shared<AstArena>()) {}
+
+Parser::Parser(const std::vector<Token>& toks, std::shared_ptr<AstArena> arena)
+    : tokens(toks), arena(std::move(arena)) {}
 
 //===----------------------------------------------------------------------===//
 // Utilities
 //===----------------------------------------------------------------------===//
 
-Token Parser::peek() {
+const Token& Parser::peek() {
     return tokens[current];
 }
 
-Token Parser::advance() {
+const Token& Parser::advance() {
     if (!isAtEnd()) current++;
     return tokens[current - 1];
 }
@@ -95,6 +101,7 @@ AccessModifier Parser::parseAccessModifier() {
 
 std::unique_ptr<ProgramAST> Parser::parse() {
     auto program = std::make_unique<ProgramAST>();
+    program->arena = arena;
 
     while (!isAtEnd()) {
         while (match(TokenType::Newline)) {}
@@ -122,9 +129,11 @@ std::unique_ptr<ProgramAST> Parser::parse() {
                 program->functions.push_back(parseFunction());
             } else {
                 std::cerr << "Unexpected token at top level: " << peek().value << std::endl;
+                errors++;
                 advance();
             }
         } catch (const std::exception& e) {
+            errors++;
             synchronize();
         }
     }
@@ -149,6 +158,7 @@ std::unique_ptr<ClassAST> Parser::parseClass() {
     expect(TokenType::Class, "Expected 'class'");
     
     auto classAST = std::make_unique<ClassAST>();
+    classAST->arena = arena;
     Token nameToken = advance();
     classAST->name = nameToken.value;
     
@@ -321,7 +331,9 @@ std::unique_ptr<FunctionAST> Parser::parseFunction() {
     // Parse body
     std::vector<StmtPtr> body = parseBlock();
 
-    return std::make_unique<FunctionAST>(funcName, std::move(args), returnType, std::move(body));
+    auto func = std::make_unique<FunctionAST>(funcName, std::move(args), returnType, std::move(body));
+    func->arena = arena;
+    return func;
 }
 
 //===----------------------------------------------------------------------===//
@@ -362,12 +374,14 @@ StmtPtr Parser::parseStatement() {
     if (check(TokenType::Try)) return parseTryCatchStatement();
     if (check(TokenType::Throw)) return parseThrowStatement();
     if (check(TokenType::Break)) {
-        advance();
-        return std::make_unique<BreakStmtAST>();
+        auto stmt = arena->make<BreakStmtAST>();
+        stmt->line = advance().line;
+        return stmt;
     }
     if (check(TokenType::Continue)) {
-        advance();
-        return std::make_unique<ContinueStmtAST>();
+        auto stmt = arena->make<ContinueStmtAST>();
+        stmt->line = advance().line;
+        return stmt;
     }
 
     return parseExpressionStatement();
@@ -377,7 +391,7 @@ StmtPtr Parser::parseReturnStatement() {
     expect(TokenType::Return, "Expected 'return'");
     int line = tokens[current-1].line;
     ExprPtr value = parseExpression();
-    auto stmt = std::make_unique<ReturnStmtAST>(std::move(value));
+    auto stmt = arena->make<ReturnStmtAST>(std::move(value));
     stmt->line = line;
     return stmt;
 }
@@ -398,7 +412,7 @@ std::vector<StmtPtr> Parser::parseElifElseChain() {
         std::vector<StmtPtr> elifBody = parseBlock();
         std::vector<StmtPtr> elifElseBody = parseElifElseChain(); // Recursively parse more elif/else
         
-        auto nestedIf = std::make_unique<IfStmtAST>(
+        auto nestedIf = arena->make<IfStmtAST>(
             std::move(elifCond), std::move(elifBody), std::move(elifElseBody));
         elseBody.push_back(std::move(nestedIf));
     } else if (check(TokenType::Else)) {
@@ -419,7 +433,7 @@ StmtPtr Parser::parseIfStatement() {
     std::vector<StmtPtr> thenBody = parseBlock();
     std::vector<StmtPtr> elseBody = parseElifElseChain();
 
-    auto stmt = std::make_unique<IfStmtAST>(std::move(cond), std::move(thenBody), std::move(elseBody));
+    auto stmt = arena->make<IfStmtAST>(std::move(cond), std::move(thenBody), std::move(elseBody));
     stmt->line = line;
     return stmt;
 }
@@ -432,7 +446,7 @@ StmtPtr Parser::parseWhileStatement() {
 
     std::vector<StmtPtr> body = parseBlock();
 
-    auto stmt = std::make_unique<WhileStmtAST>(std::move(cond), std::move(body));
+    auto stmt = arena->make<WhileStmtAST>(std::move(cond), std::move(body));
     stmt->line = line;
     return stmt;
 }
@@ -441,20 +455,16 @@ StmtPtr Parser::parseForStatement() {
     expect(TokenType::For, "Expected 'for'");
     int line = tokens[current-1].line;
     
-    Token varName = advance();
     expect(TokenType::Identifier, "Expected loop variable");
-    // Actually we already advanced, fix:
     std::string loopVar = tokens[current - 1].value;
-    
-    // Expect 'in' (which will be identifier)
-    Token inKeyword = advance();
+    expect(TokenType::In, "Expected 'in' after loop variable");
     
     ExprPtr iterable = parseExpression();
     expect(TokenType::Colon, "Expected ':' after for");
     
     std::vector<StmtPtr> body = parseBlock();
     
-    auto stmt = std::make_unique<ForStmtAST>(loopVar, std::move(iterable), std::move(body));
+    auto stmt = arena->make<ForStmtAST>(loopVar, std::move(iterable), std::move(body));
     stmt->line = line;
     return stmt;
 }
@@ -464,20 +474,37 @@ StmtPtr Parser::parseExpressionStatement() {
     if (!expr) return nullptr;
     int line = expr->line; // Use expression line
 
-    // Check for assignment
-    if (match(TokenType::Assign)) {
-        auto* varExpr = dynamic_cast<VariableExprAST*>(expr.get());
-        if (varExpr) {
-            std::string varName = varExpr->name;
+    // Check for assignment: x = v, obj.field = v, arr[i] = v, and the
+    // compound forms += and -=
+    if (check(TokenType::Assign) || check(TokenType::PlusAssign) || check(TokenType::MinusAssign)) {
+        TokenType opToken = advance().type;
+        bool compound = opToken != TokenType::Assign;
+        BinaryOp op = opToken == TokenType::MinusAssign ? BinaryOp::Sub : BinaryOp::Add;
+        if (expr->kind == ExprKind::Variable) {
+            std::string varName = static_cast<VariableExprAST*>(expr.get())->name;
             ExprPtr rhs = parseExpression();
+            if (compound) {
+                rhs = arena->make<BinaryExprAST>(op, std::move(expr), std::move(rhs));
+                rhs->line = line;
+            }
             TypeInfo type;  // Inferred
-            auto stmt = std::make_unique<VarDeclStmtAST>(varName, type, std::move(rhs));
+            auto stmt = arena->make<VarDeclStmtAST>(varName, type, std::move(rhs));
             stmt->line = line;
             return stmt;
         }
+        if (expr->kind == ExprKind::MemberAccess || expr->kind == ExprKind::Index) {
+            ExprPtr rhs = parseExpression();
+            auto stmt = arena->make<AssignStmtAST>(std::move(expr), std::move(rhs));
+            stmt->compound = compound;
+            stmt->op = op;
+            stmt->line = line;
+            return stmt;
+        }
+        std::cerr << "Parse Error: Invalid assignment target at line " << line << std::endl;
+        throw std::runtime_error("Invalid assignment target");
     }
     
-    auto stmt = std::make_unique<ExprStmtAST>(std::move(expr));
+    auto stmt = arena->make<ExprStmtAST>(std::move(expr));
     stmt->line = line;
     return stmt;
 }
@@ -517,7 +544,7 @@ StmtPtr Parser::parseTryCatchStatement() {
         finallyBody = parseBlock();
     }
     
-    return std::make_unique<TryCatchStmtAST>(
+    return arena->make<TryCatchStmtAST>(
         std::move(tryBody), exceptionVar, exceptionType,
         std::move(catchBody), std::move(finallyBody)
     );
@@ -526,7 +553,7 @@ StmtPtr Parser::parseTryCatchStatement() {
 StmtPtr Parser::parseThrowStatement() {
     expect(TokenType::Throw, "Expected 'throw'");
     ExprPtr exception = parseExpression();
-    return std::make_unique<ThrowStmtAST>(std::move(exception));
+    return arena->make<ThrowStmtAST>(std::move(exception));
 }
 
 //===----------------------------------------------------------------------===//
@@ -554,6 +581,25 @@ int Parser::getPrecedence(TokenType type) {
     }
 }
 
+// Only called for tokens with a binary precedence other than '.' and '['
+static BinaryOp binaryOpFor(TokenType type) {
+    switch (type) {
+        case TokenType::Plus: return BinaryOp::Add;
+        case TokenType::Minus: return BinaryOp::Sub;
+        case TokenType::Star: return BinaryOp::Mul;
+        case TokenType::Slash: return BinaryOp::Div;
+        case TokenType::Percent: return BinaryOp::Mod;
+        case TokenType::Equal: return BinaryOp::Equal;
+        case TokenType::NotEqual: return BinaryOp::NotEqual;
+        case TokenType::Less: return BinaryOp::Less;
+        case TokenType::Greater: return BinaryOp::Greater;
+        case TokenType::LessEqual: return BinaryOp::LessEqual;
+        case TokenType::GreaterEqual: return BinaryOp::GreaterEqual;
+        case TokenType::And: return BinaryOp::And;
+        default: return BinaryOp::Or;
+    }
+}
+
 bool isExpressionToken(TokenType type) {
     return type == TokenType::Number ||
            type == TokenType::StringStr ||
@@ -593,7 +639,6 @@ ExprPtr Parser::parseBinaryRhs(int precedence, ExprPtr lhs) {
         if (tokPrec < precedence) return lhs;
 
         Token opToken = advance();
-        std::string op = opToken.value;
         
         // Handle member access specially
         if (opToken.type == TokenType::Dot) {
@@ -612,9 +657,9 @@ ExprPtr Parser::parseBinaryRhs(int precedence, ExprPtr lhs) {
                     }
                 }
                 expect(TokenType::RParen, "Expected ')' after method arguments");
-                lhs = std::make_unique<MethodCallExprAST>(std::move(lhs), member.value, std::move(args));
+                lhs = arena->make<MethodCallExprAST>(std::move(lhs), member.value, std::move(args));
             } else {
-                lhs = std::make_unique<MemberAccessExprAST>(std::move(lhs), member.value);
+                lhs = arena->make<MemberAccessExprAST>(std::move(lhs), member.value);
             }
             continue;
         }
@@ -623,7 +668,7 @@ ExprPtr Parser::parseBinaryRhs(int precedence, ExprPtr lhs) {
         if (opToken.type == TokenType::LBracket) {
             ExprPtr index = parseExpression();
             expect(TokenType::RBracket, "Expected ']'");
-            lhs = std::make_unique<IndexExprAST>(std::move(lhs), std::move(index));
+            lhs = arena->make<IndexExprAST>(std::move(lhs), std::move(index));
             continue;
         }
 
@@ -635,7 +680,7 @@ ExprPtr Parser::parseBinaryRhs(int precedence, ExprPtr lhs) {
             rhs = parseBinaryRhs(tokPrec + 1, std::move(rhs));
         }
 
-        lhs = std::make_unique<BinaryExprAST>(op, std::move(lhs), std::move(rhs));
+        lhs = arena->make<BinaryExprAST>(binaryOpFor(opToken.type), std::move(lhs), std::move(rhs));
     }
 }
 
@@ -656,7 +701,8 @@ ExprPtr Parser::parsePrimary() {
     if (tok.type == TokenType::Not || tok.type == TokenType::Minus) {
         advance();
         ExprPtr operand = parsePrimary();
-        return std::make_unique<UnaryExprAST>(tok.value, std::move(operand));
+        UnaryOp op = tok.type == TokenType::Not ? UnaryOp::Not : UnaryOp::Negate;
+        return arena->make<UnaryExprAST>(op, std::move(operand));
     }
 
     // New expression
@@ -667,7 +713,7 @@ ExprPtr Parser::parsePrimary() {
     // Self/This
     if (tok.type == TokenType::Self || tok.type == TokenType::This) {
         advance();
-        auto node = std::make_unique<SelfExprAST>();
+        auto node = arena->make<SelfExprAST>();
         node->line = tok.line;
         return node;
     }
@@ -675,7 +721,7 @@ ExprPtr Parser::parsePrimary() {
     // Number
     if (tok.type == TokenType::Number) {
         advance();
-        auto node = std::make_unique<NumberExprAST>(std::stod(tok.value));
+        auto node = arena->make<NumberExprAST>(std::stod(tok.value));
         node->line = tok.line;
         return node;
     }
@@ -683,7 +729,7 @@ ExprPtr Parser::parsePrimary() {
     // String
     if (tok.type == TokenType::StringStr) {
         advance();
-        auto node = std::make_unique<StringExprAST>(tok.value);
+        auto node = arena->make<StringExprAST>(tok.value);
         node->line = tok.line;
         return node;
     }
@@ -691,9 +737,7 @@ ExprPtr Parser::parsePrimary() {
     // F-String (interpolated)
     if (tok.type == TokenType::FString) {
         advance();
-        auto node = std::make_unique<FStringExprAST>(tok.value);
-        node->line = tok.line;
-        return node;
+        return parseFString(tok);
     }
 
     // Identifier or function call or lambda
@@ -705,7 +749,7 @@ ExprPtr Parser::parsePrimary() {
             advance(); // consume ->
             std::vector<std::string> params = {tok.value};
             ExprPtr body = parseExpression();
-            auto node = std::make_unique<LambdaExprAST>(std::move(params), std::move(body));
+            auto node = arena->make<LambdaExprAST>(std::move(params), std::move(body));
             node->line = tok.line;
             return node;
         }
@@ -713,7 +757,7 @@ ExprPtr Parser::parsePrimary() {
         if (check(TokenType::LParen)) {
             return parseCallExpr(tok.value); // parseCallExpr needs update too?
         }
-        auto node = std::make_unique<VariableExprAST>(tok.value);
+        auto node = arena->make<VariableExprAST>(tok.value);
         node->line = tok.line;
         return node;
     }
@@ -733,7 +777,22 @@ ExprPtr Parser::parsePrimary() {
         if (check(TokenType::LParen)) {
             return parseCallExpr(typeName);
         }
-        return std::make_unique<VariableExprAST>(typeName);
+        return arena->make<VariableExprAST>(typeName);
+    }
+
+    // Lambda with a parameter list: (a, b) -> a + b, () -> 0
+    if (tok.type == TokenType::LParen && isLambdaParams()) {
+        advance();
+        std::vector<std::string> params;
+        while (!match(TokenType::RParen)) {
+            params.push_back(advance().value);
+            match(TokenType::Comma);
+        }
+        expect(TokenType::Arrow, "Expected '->' after lambda parameters");
+        ExprPtr body = parseExpression();
+        auto node = arena->make<LambdaExprAST>(std::move(params), std::move(body));
+        node->line = tok.line;
+        return node;
     }
 
     // Parenthesized expression
@@ -754,12 +813,28 @@ ExprPtr Parser::parsePrimary() {
             }
         }
         expect(TokenType::RBracket, "Expected ']'");
-        return std::make_unique<ArrayExprAST>(std::move(elements));
+        return arena->make<ArrayExprAST>(std::move(elements));
     }
 
     return nullptr;
 }
 
+// At '(': whether it opens a lambda's parameter list, i.e. names separated
+// by commas, then ')' and '->'
+bool Parser::isLambdaParams() {
+    size_t i = current + 1;
+    if (tokens[i].type != TokenType::RParen) {
+        while (true) {
+            if (tokens[i].type != TokenType::Identifier) return false;
+            i++;
+            if (tokens[i].type == TokenType::RParen) break;
+            if (tokens[i].type != TokenType::Comma) return false;
+            i++;
+        }
+    }
+    return tokens[i + 1].type == TokenType::Arrow;
+}
+
 ExprPtr Parser::parseNewExpr() {
     expect(TokenType::New, "Expected 'new'");
     Token className = advance();
@@ -777,7 +852,7 @@ ExprPtr Parser::parseNewExpr() {
     }
     expect(TokenType::RParen, "Expected ')' after constructor arguments");
     
-    return std::make_unique<NewExprAST>(className.value, std::move(args));
+    return arena->make<NewExprAST>(className.value, std::move(args));
 }
 
 ExprPtr Parser::parseCallExpr(const std::string& callee) {
@@ -797,5 +872,117 @@ ExprPtr Parser::parseCallExpr(const std::string& callee) {
     }
     expect(TokenType::RParen, "Expected ')' after arguments");
 
-    return std::make_unique<CallExprAST>(callee, std::move(args));
+    return arena->make<CallExprAST>(callee, std::move(args));
+}
+
+static void fstringError(const std::string& msg, int line) {
+    std::cerr << "Parse Error: " << msg << " at line " << line << std::endl;
+    throw std::runtime_error(msg);
+}
+
+// [[fill]align][+][0][width][,][.precision][type]
+static std::unique_ptr<FormatSpec> parseFormatSpec(const std::string& text, int line) {
+    auto spec = std::make_unique<FormatSpec>();
+    auto isAlign = [](char c) { return c == '<' || c == '>' || c == '^'; };
+    size_t i = 0, n = text.length();
+    if (n >= 2 && isAlign(text[1])) {
+        spec->fill = text[0];
+        spec->align = text[1];
+        i = 2;
+    } else if (n >= 1 && isAlign(text[0])) {
+        spec->align = text[0];
+        i = 1;
+    }
+    if (i < n && text[i] == '+') { spec->plus = true; i++; }
+    if (i < n && text[i] == '0') { spec->zeroPad = true; i++; }
+    while (i < n && std::isdigit((unsigned char)text[i])) spec->width = spec->width * 10 + (text[i++] - '0');
+    if (i < n && text[i] == ',') { spec->grouping = true; i++; }
+    if (i < n && text[i] == '.') {
+        i++;
+        if (i == n || !std::isdigit((unsigned char)text[i])) i = n + 1;
+        else spec->precision = 0;
+        while (i < n && std::isdigit((unsigned char)text[i])) spec->precision = spec->precision * 10 + (text[i++] - '0');
+    }
+    if (i < n && std::strchr("dxfe%s", text[i])) spec->type = text[i++];
+    if (i != n) fstringError("Invalid format spec ':" + text + "' in f-string", line);
+    return spec;
+}
+
+// Splits f"Total: {price * qty:.2f}" into literal text and placeholders
+// once: each placeholder's expression is parsed here and its format spec
+// decoded, so neither engine rescans the template at run time. {{ and }}
+// stand for literal braces.
+ExprPtr Parser::parseFString(const Token& tok) {
+    auto node = arena->make<FStringExprAST>(tok.value);
+    node->line = tok.line;
+
+    const std::string& tmpl = tok.value;
+    std::string literal;
+    size_t i = 0;
+    while (i < tmpl.length()) {
+        char c = tmpl[i];
+        if ((c == '{' || c == '}') && i + 1 < tmpl.length() && tmpl[i + 1] == c) {
+            literal += c;
+            i += 2;
+            continue;
+        }
+        if (c != '{') {
+            literal += tmpl[i++];
+            continue;
+        }
+
+        // Find the closing brace and the spec's ':', skipping over brackets
+        // and quoted strings inside the expression
+        size_t end = i + 1, colon = std::string::npos;
+        int depth = 0;
+        char quote = 0;
+        for (; end < tmpl.length(); end++) {
+            char ch = tmpl[end];
+            if (quote) {
+                if (ch == quote) quote = 0;
+            } else if (ch == '"' || ch == '\'') {
+                quote = ch;
+            } else if (ch == '(' || ch == '[') {
+                depth++;
+            } else if (ch == ')' || ch == ']') {
+                depth--;
+            } else if (depth == 0 && ch == ':' && colon == std::string::npos) {
+                colon = end;
+            } else if (depth == 0 && ch == '}') {
+                break;
+            }
+        }
+        if (end == tmpl.length()) fstringError("Unterminated '{' in f-string", tok.line);
+
+        size_t exprEnd = colon != std::string::npos ? colon : end;
+        std::string source = tmpl.substr(i + 1, exprEnd - i - 1);
+        if (source.find_first_not_of(" \t") == std::string::npos) {
+            fstringError("Empty expression in f-string placeholder", tok.line);
+        }
+        std::vector<Token> exprTokens = Lexer(source).tokenize();
+        for (auto& t : exprTokens) t.line = tok.line;
+        Parser sub(exprTokens, arena);
+        ExprPtr expr = sub.parseExpression();
+        if (!sub.isAtEnd()) {
+            fstringError("Unexpected '" + sub.peek().value + "' in f-string placeholder", tok.line);
+        }
+
+        if (!literal.empty()) {
+            node->sizeHint += literal.length();
+            node->parts.push_back({literal, nullptr, nullptr});
+            literal.clear();
+        }
+        FStringPart part{"", std::move(expr), nullptr};
+        if (colon != std::string::npos) {
+            part.spec = parseFormatSpec(tmpl.substr(colon + 1, end - colon - 1), tok.line);
+        }
+        node->sizeHint += std::max(part.spec ? part.spec->width : 0, 8);
+        node->parts.push_back(std::move(part));
+        i = end + 1;
+    }
+    if (!literal.empty()) {
+        node->sizeHint += literal.length();
+        node->parts.push_back({literal, nullptr, nullptr});
+    }
+    return node;
 }
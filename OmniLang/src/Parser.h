@@ -6,16 +6,22 @@
 
 class Parser {
 public:
+    // tokens must outlive the parser. Nodes go into a new arena, or into
+    // `arena` for a parser reading part of a larger program.
     Parser(const std::vector<Token>& tokens);
+    Parser(const std::vector<Token>& tokens, std::shared_ptr<AstArena> arena);
     std::unique_ptr<ProgramAST> parse();
+    bool hadErrors() const { return errors > 0; }  // Some declaration was skipped
 
 private:
-    std::vector<Token> tokens;
+    const std::vector<Token>& tokens;
+    std::shared_ptr<AstArena> arena;
     int current = 0;
+    int errors = 0;
 
     // Utility methods
-    Token peek();
-    Token advance();
+    const Token& peek();
+    const Token& advance();
     bool check(TokenType type);
     bool match(TokenType type);
     bool isAtEnd();
@@ -51,5 +57,7 @@ private:
     ExprPtr parseBinaryRhs(int precedence, ExprPtr lhs);
     ExprPtr parseCallExpr(const std::string& callee);
     ExprPtr parseNewExpr();
+    ExprPtr parseFString(const Token& tok);
+    bool isLambdaParams();
     int getPrecedence(TokenType type);
 };
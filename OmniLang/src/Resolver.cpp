@@ -0,0 +1,594 @@
+#include "Resolver.h"
+#include <algorithm>
+#include "StdLib.h"
+
+//===----------------------------------------------------------------------===//
+// Entry Points
+//===----------------------------------------------------------------------===//
+
+void Resolver::resolve(ProgramAST& program) {
+    for (auto& cls : program.classes) {
+        resolveClass(cls.get());
+    }
+    for (auto& func : program.functions) {
+        resolveFunction(func.get());
+    }
+}
+
+void Resolver::resolveClass(ClassAST* cls) {
+    // Field initializers run in a frame that only holds the new object
+    beginFunction(nullptr);
+    for (auto& field : cls->fields) {
+        resolveExpr(field.initializer.get());
+    }
+    if (cls->constructor) resolveFunction(cls->constructor.get());
+    for (auto& method : cls->methods) {
+        resolveFunction(method.get());
+    }
+}
+
+void Resolver::resolveFunction(FunctionAST* func) {
+    beginFunction(func);
+    func->arity = 0;
+    for (auto& arg : func->args) {
+        if (arg.name == "self") continue;
+        declareLocal(arg.name);
+        func->arity++;
+    }
+    for (auto& stmt : func->body) {
+        resolveStmt(stmt.get());
+    }
+}
+
+void Resolver::resolveScript(FunctionAST* func) {
+    scriptMode = true;
+    resolveFunction(func);
+    scriptMode = false;
+}
+
+//===----------------------------------------------------------------------===//
+// Classes
+//===----------------------------------------------------------------------===//
+
+void Resolver::linkClasses(const std::unordered_map<std::string, ClassAST*>& classes) {
+    for (auto& [name, cls] : classes) {
+        cls->parent = nullptr;
+        if (cls->parentClass.empty()) continue;
+        auto it = classes.find(cls->parentClass);
+        if (it == classes.end()) {
+            throw OmniException("Unknown parent class '" + cls->parentClass + "' of class '" + name + "'");
+        }
+        cls->parent = it->second;
+    }
+
+    // Walk each chain from the root down so subclasses override their
+    // parents. Instances lay out __class__ first, then the fields in the
+    // order they are initialized.
+    static const Symbol classKey("__class__");
+    for (auto& [name, cls] : classes) {
+        std::vector<ClassAST*> chain;
+        for (ClassAST* c = cls; c; c = c->parent) {
+            if (chain.size() == classes.size()) {
+                throw OmniException("Class '" + name + "' inherits from itself");
+            }
+            chain.push_back(c);
+        }
+        cls->methodTable.clear();
+        cls->initializer = nullptr;
+        for (auto c = chain.rbegin(); c != chain.rend(); ++c) {
+            for (auto& method : (*c)->methods) {
+                cls->methodTable[method->name] = method.get();
+            }
+            if ((*c)->constructor) cls->initializer = (*c)->constructor.get();
+        }
+        Shape* shape = Shape::empty()->withField(classKey);
+        for (auto c = chain.rbegin(); c != chain.rend() && shape; ++c) {
+            for (auto& field : (*c)->fields) {
+                Symbol fieldName(field.name);
+                if (shape->find(fieldName) < 0) shape = shape->withField(fieldName);
+                if (!shape) break;
+            }
+        }
+        cls->shape = shape;
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Scopes
+//===----------------------------------------------------------------------===//
+
+void Resolver::beginFunction(FunctionAST* target) {
+    fn = target;
+    if (fn) fn->numSlots = 1;
+    blocks.clear();
+    blocks.emplace_back();
+    liveSlots = 1;  // slot 0 is self
+    loopDepth = 0;
+    assignedSlots.clear();
+}
+
+void Resolver::beginBlock() {
+    blocks.emplace_back();
+}
+
+// Every block-local is assigned before it can be read, so a later block may
+// take over the slots without clearing them.
+void Resolver::endBlock() {
+    liveSlots -= (int)blocks.back().size();
+    blocks.pop_back();
+}
+
+int Resolver::declareLocal(const std::string& name) {
+    int slot = liveSlots++;
+    blocks.back()[name] = slot;
+    if (fn && liveSlots > fn->numSlots) fn->numSlots = liveSlots;
+    if (lambda && liveSlots > lambda->numSlots) lambda->numSlots = liveSlots;
+    return slot;
+}
+
+VarRef Resolver::lookup(const std::string& name) {
+    VarRef ref;
+    if (findLocal(name, ref) || !globals) return ref;
+    ref.kind = VarRef::Global;
+    ref.index = globals->lookup(name);
+    return ref;
+}
+
+// A local of the current frame, captured into it if this is a lambda
+bool Resolver::findLocal(const std::string& name, VarRef& ref) {
+    for (int i = (int)blocks.size() - 1; i >= 0; i--) {
+        auto it = blocks[i].find(name);
+        if (it != blocks[i].end()) {
+            ref.kind = VarRef::Local;
+            ref.index = it->second;
+            return true;
+        }
+    }
+    if (!lambda) return false;
+
+    VarRef outer;
+    if (!capture(enclosing.size(), name, outer)) return false;
+    lambda->captures.push_back(outer);
+    ref.kind = VarRef::Local;
+    ref.index = declareLocal(name);
+    return true;
+}
+
+// As findLocal, for the suspended frame enclosing[depth - 1]. A lambda
+// nested in lambdas captures through each of them.
+bool Resolver::capture(size_t depth, const std::string& name, VarRef& ref) {
+    if (depth == 0) return false;
+    Frame& frame = enclosing[depth - 1];
+    for (int i = (int)frame.blocks.size() - 1; i >= 0; i--) {
+        auto it = frame.blocks[i].find(name);
+        if (it != frame.blocks[i].end()) {
+            ref.kind = VarRef::Local;
+            ref.index = it->second;
+            return true;
+        }
+    }
+    if (!frame.lambda) return false;
+
+    VarRef outer;
+    if (!capture(depth - 1, name, outer)) return false;
+    frame.lambda->captures.push_back(outer);
+    ref.kind = VarRef::Local;
+    ref.index = frame.liveSlots++;
+    frame.blocks.back()[name] = ref.index;
+    if (frame.liveSlots > frame.lambda->numSlots) frame.lambda->numSlots = frame.liveSlots;
+    return true;
+}
+
+VarRef Resolver::assignTarget(const std::string& name) {
+    VarRef ref = lookup(name);
+    if (ref.kind != VarRef::Local) {
+        if (scriptMode && blocks.size() == 1) return ref;
+        ref.kind = VarRef::Local;
+        ref.index = declareLocal(name);
+    }
+    assignedSlots.push_back(ref.index);
+    return ref;
+}
+
+//===----------------------------------------------------------------------===//
+// Statements
+//===----------------------------------------------------------------------===//
+
+void Resolver::resolveBlock(std::vector<StmtPtr>& body) {
+    beginBlock();
+    for (auto& stmt : body) {
+        resolveStmt(stmt.get());
+    }
+    endBlock();
+}
+
+void Resolver::resolveStmt(StmtAST* stmt) {
+    if (!stmt) return;
+
+    switch (stmt->kind) {
+    case StmtKind::Expr:
+        resolveExpr(static_cast<ExprStmtAST*>(stmt)->expr.get());
+        return;
+
+    case StmtKind::VarDecl: {
+        auto* varDecl = static_cast<VarDeclStmtAST*>(stmt);
+        // The initializer cannot see the variable it defines
+        resolveExpr(varDecl->initializer.get());
+        varDecl->target = assignTarget(varDecl->name);
+        markReusedVar(varDecl);
+        return;
+    }
+
+    case StmtKind::Assign: {
+        auto* assign = static_cast<AssignStmtAST*>(stmt);
+        resolveExpr(assign->value.get());
+        resolveExpr(assign->target.get());
+        markReusedField(assign);
+        return;
+    }
+
+    case StmtKind::Return:
+        resolveExpr(static_cast<ReturnStmtAST*>(stmt)->value.get());
+        return;
+
+    case StmtKind::If: {
+        auto* ifStmt = static_cast<IfStmtAST*>(stmt);
+        resolveExpr(ifStmt->condition.get());
+        resolveBlock(ifStmt->thenBody);
+        resolveBlock(ifStmt->elseBody);
+        return;
+    }
+
+    case StmtKind::While: {
+        auto* whileStmt = static_cast<WhileStmtAST*>(stmt);
+        resolveExpr(whileStmt->condition.get());
+        loopDepth++;
+        resolveBlock(whileStmt->body);
+        loopDepth--;
+        return;
+    }
+
+    case StmtKind::For: {
+        auto* forStmt = static_cast<ForStmtAST*>(stmt);
+        beginBlock();
+        resolveExpr(forStmt->iterable.get());
+        forStmt->iterSlot = declareLocal("(for iterable)");
+        forStmt->indexSlot = declareLocal("(for index)");
+        size_t firstWrite = assignedSlots.size();
+        beginBlock();
+        forStmt->var = assignTarget(forStmt->varName);
+        loopDepth++;
+        for (auto& s : forStmt->body) {
+            resolveStmt(s.get());
+        }
+        loopDepth--;
+        endBlock();
+        endBlock();
+
+        // A local the loop never reassigns can be iterated where it lives
+        // instead of being copied into the hidden slot
+        if (forStmt->iterable->kind == ExprKind::Variable) {
+            VarRef source = static_cast<VariableExprAST*>(forStmt->iterable.get())->ref;
+            if (source.kind == VarRef::Local &&
+                std::find(assignedSlots.begin() + firstWrite, assignedSlots.end(), source.index) == assignedSlots.end()) {
+                forStmt->iterSlot = source.index;
+                forStmt->iterInPlace = true;
+            }
+        }
+        return;
+    }
+
+    case StmtKind::TryCatch: {
+        auto* tryStmt = static_cast<TryCatchStmtAST*>(stmt);
+        resolveBlock(tryStmt->tryBody);
+        beginBlock();
+        tryStmt->exceptionRef = assignTarget(tryStmt->exceptionVar);
+        for (auto& s : tryStmt->catchBody) {
+            resolveStmt(s.get());
+        }
+        endBlock();
+        resolveBlock(tryStmt->finallyBody);
+        return;
+    }
+
+    case StmtKind::Throw:
+        resolveExpr(static_cast<ThrowStmtAST*>(stmt)->exception.get());
+        return;
+
+    case StmtKind::Break:
+    case StmtKind::Continue:
+        if (loopDepth == 0) {
+            bool isBreak = stmt->kind == StmtKind::Break;
+            throw OmniException(std::string(isBreak ? "'break'" : "'continue'") + " outside of a loop", stmt->line);
+        }
+        return;
+    }
+}
+
+// x = List.add(x, v) and s = s + a + b: the old value of the variable is
+// dead once the operands that read it are evaluated, so the builtin or the
+// + may take over its container or string
+void Resolver::markReusedVar(VarDeclStmtAST* varDecl) {
+    ExprAST* init = varDecl->initializer.get();
+    if (!init) return;
+    const VarRef& target = varDecl->target;
+
+    if (init->kind == ExprKind::MethodCall) {
+        auto* call = static_cast<MethodCallExprAST*>(init);
+        if (updatesFirstArg(call) && isVariable(call->args[0].get(), target)) {
+            call->reusedVar = target;
+        }
+        return;
+    }
+
+    // All parts are evaluated before the variable is released
+    if (init->kind == ExprKind::Concat) {
+        auto* concat = static_cast<ConcatExprAST*>(init);
+        if (isVariable(concat->parts[0].get(), target)) {
+            concat->reusedVar = target;
+            return;
+        }
+        // s = s + str(i) + ",": the chain's head is a plain + the Optimizer
+        // could not fuse, and it releases s before the later parts run
+        if (target.kind != VarRef::Local) return;
+        for (size_t i = 1; i < concat->parts.size(); i++) {
+            if (!cannotThrow(concat->parts[i].get()) || mentions(concat->parts[i].get(), target)) return;
+        }
+        init = concat->parts[0].get();
+    }
+
+    // The variable is released before the outer operands run, so none of
+    // them may read it (a global could be read by any call), and none may
+    // throw, or a caught exception would leave the variable null
+    if (target.kind != VarRef::Local) return;
+    BinaryExprAST* innermost = nullptr;
+    for (ExprAST* e = init; e->kind == ExprKind::Binary; ) {
+        auto* binary = static_cast<BinaryExprAST*>(e);
+        if (binary->op != BinaryOp::Add) return;
+        if (innermost && (!cannotThrow(innermost->rhs.get()) || mentions(innermost->rhs.get(), target))) return;
+        innermost = binary;
+        e = binary->lhs.get();
+    }
+    if (innermost && isVariable(innermost->lhs.get(), target)) {
+        innermost->reusedVar = target;
+    }
+}
+
+// self.xs = List.add(self.xs, v), or obj.xs for an object in a variable:
+// as above, with the field cleared instead. Only the builtin runs between
+// clearing it and storing the result, so nothing sees the field empty.
+void Resolver::markReusedField(AssignStmtAST* assign) {
+    if (assign->compound || assign->target->kind != ExprKind::MemberAccess) return;
+    if (assign->value->kind != ExprKind::MethodCall) return;
+    auto* target = static_cast<MemberAccessExprAST*>(assign->target.get());
+    auto* call = static_cast<MethodCallExprAST*>(assign->value.get());
+    if (!updatesFirstArg(call) || call->args[0]->kind != ExprKind::MemberAccess) return;
+    auto* field = static_cast<MemberAccessExprAST*>(call->args[0].get());
+    if (field->member == target->member && sameObject(field->object.get(), target->object.get())) {
+        call->reusedField = field;
+    }
+}
+
+// A builtin from StdLib::getUpdatingFunctions, called with its first argument
+bool Resolver::updatesFirstArg(MethodCallExprAST* call) {
+    if (!call->moduleFunc || call->args.empty()) return false;
+    auto& updating = StdLib::getUpdatingFunctions();
+    auto* module = static_cast<VariableExprAST*>(call->object.get());
+    auto it = updating.find(module->name + "." + call->methodName);
+    return it != updating.end() && call->args.size() >= it->second;
+}
+
+// Both self, or both the same variable
+bool Resolver::sameObject(ExprAST* a, ExprAST* b) {
+    if (a->kind == ExprKind::Self) return b->kind == ExprKind::Self;
+    if (a->kind != ExprKind::Variable) return false;
+    const VarRef& ref = static_cast<VariableExprAST*>(a)->ref;
+    return ref.kind != VarRef::Unresolved && isVariable(b, ref);
+}
+
+bool Resolver::isVariable(ExprAST* expr, const VarRef& ref) {
+    if (expr->kind != ExprKind::Variable) return false;
+    const VarRef& var = static_cast<VariableExprAST*>(expr)->ref;
+    return var.kind == ref.kind && var.index == ref.index;
+}
+
+// Literals and variable reads: the operands whose evaluation never throws
+bool Resolver::cannotThrow(ExprAST* expr) {
+    switch (expr->kind) {
+    case ExprKind::Number:
+    case ExprKind::String:
+    case ExprKind::Variable:
+    case ExprKind::Self:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Whether evaluating expr may read the variable. Making a lambda reads
+// what it captures; calling a function may read any global.
+bool Resolver::mentions(ExprAST* expr, const VarRef& ref) {
+    if (!expr) return false;
+    auto any = [&](const std::vector<ExprPtr>& exprs) {
+        for (auto& e : exprs) {
+            if (mentions(e.get(), ref)) return true;
+        }
+        return false;
+    };
+
+    switch (expr->kind) {
+    case ExprKind::Number:
+    case ExprKind::String:
+    case ExprKind::Self:
+        return false;
+    case ExprKind::Variable:
+        return isVariable(expr, ref);
+    case ExprKind::FString:
+        for (auto& part : static_cast<FStringExprAST*>(expr)->parts) {
+            if (part.expr && mentions(part.expr.get(), ref)) return true;
+        }
+        return false;
+    case ExprKind::Binary: {
+        auto* binary = static_cast<BinaryExprAST*>(expr);
+        return mentions(binary->lhs.get(), ref) || mentions(binary->rhs.get(), ref);
+    }
+    case ExprKind::Unary:
+        return mentions(static_cast<UnaryExprAST*>(expr)->operand.get(), ref);
+    case ExprKind::Call: {
+        auto* call = static_cast<CallExprAST*>(expr);
+        const VarRef& callee = call->closure;
+        return (callee.kind == ref.kind && callee.index == ref.index) || any(call->args);
+    }
+    case ExprKind::MethodCall: {
+        auto* methodCall = static_cast<MethodCallExprAST*>(expr);
+        return mentions(methodCall->object.get(), ref) || any(methodCall->args);
+    }
+    case ExprKind::MemberAccess:
+        return mentions(static_cast<MemberAccessExprAST*>(expr)->object.get(), ref);
+    case ExprKind::New:
+        return any(static_cast<NewExprAST*>(expr)->args);
+    case ExprKind::Array:
+        return any(static_cast<ArrayExprAST*>(expr)->elements);
+    case ExprKind::Index: {
+        auto* idx = static_cast<IndexExprAST*>(expr);
+        return mentions(idx->array.get(), ref) || mentions(idx->index.get(), ref);
+    }
+    case ExprKind::Concat:
+        return any(static_cast<ConcatExprAST*>(expr)->parts);
+    case ExprKind::Lambda:
+        // Making a lambda reads only the variables it captures
+        for (auto& captured : static_cast<LambdaExprAST*>(expr)->captures) {
+            if (captured.kind == ref.kind && captured.index == ref.index) return true;
+        }
+        return false;
+    }
+    return true;
+}
+
+//===----------------------------------------------------------------------===//
+// Expressions
+//===----------------------------------------------------------------------===//
+
+void Resolver::resolveVariable(VariableExprAST* var) {
+    // Literal names are handled by the engines and never stored
+    if (var->name == "true" || var->name == "false" || var->name == "null") return;
+    var->ref = lookup(var->name);
+}
+
+void Resolver::resolveExpr(ExprAST* expr) {
+    if (!expr) return;
+
+    switch (expr->kind) {
+    case ExprKind::Number:
+    case ExprKind::String:
+    case ExprKind::Self:
+        return;
+
+    case ExprKind::FString:
+        for (auto& part : static_cast<FStringExprAST*>(expr)->parts) {
+            if (part.expr) resolveExpr(part.expr.get());
+        }
+        return;
+
+    case ExprKind::Variable:
+        resolveVariable(static_cast<VariableExprAST*>(expr));
+        return;
+
+    case ExprKind::Binary: {
+        auto* binary = static_cast<BinaryExprAST*>(expr);
+        resolveExpr(binary->lhs.get());
+        resolveExpr(binary->rhs.get());
+        return;
+    }
+
+    case ExprKind::Unary:
+        resolveExpr(static_cast<UnaryExprAST*>(expr)->operand.get());
+        return;
+
+    case ExprKind::Call: {
+        auto* call = static_cast<CallExprAST*>(expr);
+        call->native = StdLib::find(call->callee);
+        if (!call->native && !findLocal(call->callee, call->closure) && globals) {
+            auto global = globals->index.find(call->callee);
+            if (global != globals->index.end()) call->closure = {VarRef::Global, global->second};
+        }
+        for (auto& arg : call->args) {
+            resolveExpr(arg.get());
+        }
+        return;
+    }
+
+    case ExprKind::MethodCall: {
+        auto* methodCall = static_cast<MethodCallExprAST*>(expr);
+        // Module calls (Math.sqrt, ...) name a module, not a variable
+        if (methodCall->object->kind == ExprKind::Variable) {
+            auto* var = static_cast<VariableExprAST*>(methodCall->object.get());
+            methodCall->moduleFunc = StdLib::find(var->name + "." + methodCall->methodName);
+        }
+        if (!methodCall->moduleFunc) {
+            resolveExpr(methodCall->object.get());
+            methodCall->stringMethod = StdLib::find("String." + methodCall->methodName);
+            methodCall->arrayMethod = StdLib::findMethod(ValueType::Array, methodCall->methodName);
+            methodCall->mapMethod = StdLib::findMethod(ValueType::Object, methodCall->methodName);
+        }
+        for (auto& arg : methodCall->args) {
+            resolveExpr(arg.get());
+        }
+        return;
+    }
+
+    case ExprKind::MemberAccess:
+        resolveExpr(static_cast<MemberAccessExprAST*>(expr)->object.get());
+        return;
+
+    case ExprKind::New:
+        for (auto& arg : static_cast<NewExprAST*>(expr)->args) {
+            resolveExpr(arg.get());
+        }
+        return;
+
+    case ExprKind::Array:
+        for (auto& elem : static_cast<ArrayExprAST*>(expr)->elements) {
+            resolveExpr(elem.get());
+        }
+        return;
+
+    case ExprKind::Index: {
+        auto* idx = static_cast<IndexExprAST*>(expr);
+        resolveExpr(idx->array.get());
+        resolveExpr(idx->index.get());
+        return;
+    }
+
+    case ExprKind::Concat:
+        for (auto& part : static_cast<ConcatExprAST*>(expr)->parts) {
+            resolveExpr(part.get());
+        }
+        return;
+
+    case ExprKind::Lambda:
+        resolveLambda(static_cast<LambdaExprAST*>(expr));
+        return;
+    }
+}
+
+void Resolver::resolveLambda(LambdaExprAST* target) {
+    enclosing.push_back({fn, lambda, std::move(blocks), liveSlots, loopDepth, std::move(assignedSlots)});
+    beginFunction(nullptr);
+    lambda = target;
+    lambda->captures.clear();
+    lambda->numSlots = 1;
+    for (auto& param : lambda->params) {
+        declareLocal(param);
+    }
+    resolveExpr(lambda->body.get());
+
+    Frame& frame = enclosing.back();
+    fn = frame.fn;
+    lambda = frame.lambda;
+    blocks = std::move(frame.blocks);
+    liveSlots = frame.liveSlots;
+    loopDepth = frame.loopDepth;
+    assignedSlots = std::move(frame.assignedSlots);
+    enclosing.pop_back();
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "AST.h"
+
+// Names of global variables, in index order. One table is shared by every
+// resolution pass of an engine so REPL lines see earlier lines' globals.
+struct GlobalTable {
+    std::vector<std::string> names;
+    std::unordered_map<std::string, int> index;
+
+    int lookup(const std::string& name) {
+        auto it = index.find(name);
+        if (it != index.end()) return it->second;
+        int idx = (int)names.size();
+        names.push_back(name);
+        index[name] = idx;
+        return idx;
+    }
+
+    size_t size() const { return names.size(); }
+};
+
+// Runs between parsing and execution: binds every variable reference to a
+// frame slot (VarRef::Local) or a global index (VarRef::Global) and records
+// each function's frame size.
+//
+// Scoping follows the interpreter's rules: assignment updates the nearest
+// visible variable or declares a new one in the innermost block, and names
+// that are not visible locally are globals. Blocks only reserve slots, so
+// entering one costs nothing at run time; a finished block's slots are
+// reused by later blocks.
+//
+// A lambda gets its own frame. A name it does not bind itself but that is
+// a local of an enclosing frame is captured: it gets a slot after the
+// parameters, and the Resolver records where the value is copied from.
+//
+// Imported modules are resolved once and shared by every engine (see
+// ModuleRegistry), so they are resolved without a global table: names
+// they do not bind stay unresolved and read as null, like a global that
+// was never assigned.
+class Resolver {
+public:
+    explicit Resolver(GlobalTable& globals) : globals(&globals) {}
+    Resolver() = default;   // For module code
+
+    void resolve(ProgramAST& program);
+    void resolveClass(ClassAST* cls);
+    void resolveFunction(FunctionAST* func);
+
+    // REPL input: top-level assignments define globals that persist
+    // between lines.
+    void resolveScript(FunctionAST* func);
+
+    // Binds each class to its parent and builds its method table, inherited
+    // methods included. `classes` holds every class an engine registered.
+    static void linkClasses(const std::unordered_map<std::string, ClassAST*>& classes);
+
+private:
+    GlobalTable* globals = nullptr;
+    FunctionAST* fn = nullptr;
+    std::vector<std::unordered_map<std::string, int>> blocks;
+    int liveSlots = 0;
+    int loopDepth = 0;
+    bool scriptMode = false;
+    std::vector<int> assignedSlots;     // Local slots assigned so far in this function
+    LambdaExprAST* lambda = nullptr;    // Lambda whose frame is being resolved
+
+    // Frames suspended while resolving a lambda inside them, outermost first
+    struct Frame {
+        FunctionAST* fn;
+        LambdaExprAST* lambda;
+        std::vector<std::unordered_map<std::string, int>> blocks;
+        int liveSlots;
+        int loopDepth;
+        std::vector<int> assignedSlots;
+    };
+    std::vector<Frame> enclosing;
+
+    void beginFunction(FunctionAST* target);
+    void beginBlock();
+    void endBlock();
+    int declareLocal(const std::string& name);
+    VarRef lookup(const std::string& name);
+    bool findLocal(const std::string& name, VarRef& ref);
+    bool capture(size_t depth, const std::string& name, VarRef& ref);
+    VarRef assignTarget(const std::string& name);
+
+    void resolveBlock(std::vector<StmtPtr>& body);
+    void resolveStmt(StmtAST* stmt);
+    void resolveExpr(ExprAST* expr);
+    void resolveVariable(VariableExprAST* var);
+    void resolveLambda(LambdaExprAST* target);
+    void markReusedVar(VarDeclStmtAST* varDecl);
+    static void markReusedField(AssignStmtAST* assign);
+    static bool updatesFirstArg(MethodCallExprAST* call);
+    static bool sameObject(ExprAST* a, ExprAST* b);
+    static bool isVariable(ExprAST* expr, const VarRef& ref);
+    static bool mentions(ExprAST* expr, const VarRef& ref);
+    static bool cannotThrow(ExprAST* expr);
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <utility>
+#include "Symbol.h"
+
+//===----------------------------------------------------------------------===//
+// Shapes
+//===----------------------------------------------------------------------===//
+
+// The layout of a class instance: the field stored in each slot of the
+// object's value array. Objects that gained the same fields in the same
+// order share one Shape, so an access site can remember a field's slot and
+// check it with a single pointer compare.
+//
+// Adding a field follows a transition to the shape with that field
+// appended; each transition is created once and then reused. Shapes are
+// never freed.
+class Shape {
+public:
+    // Objects that would need more fields go back to a hash map
+    static constexpr size_t kMaxFields = 64;
+
+    // The shape with no fields, where every transition chain starts
+    static Shape* empty() {
+        static auto* root = new Shape();
+        return root;
+    }
+
+    size_t size() const { return names.size(); }
+    Symbol name(size_t slot) const { return names[slot]; }
+
+    // Slot of a field, or -1
+    int find(Symbol field) const {
+        if (index) {
+            auto it = index->find(field);
+            return it != index->end() ? it->second : -1;
+        }
+        for (size_t i = 0; i < names.size(); i++) {
+            if (names[i] == field) return (int)i;
+        }
+        return -1;
+    }
+
+    // This layout with field added in the next slot; null past kMaxFields
+    Shape* withField(Symbol field) {
+        for (auto& [name, next] : transitions) {
+            if (name == field) return next;
+        }
+        if (names.size() >= kMaxFields) return nullptr;
+        auto* next = new Shape();
+        next->names = names;
+        next->names.push_back(field);
+        if (next->names.size() > kLinearSearch) {
+            next->index = std::make_unique<std::unordered_map<Symbol, int>>();
+            for (size_t i = 0; i < next->names.size(); i++) (*next->index)[next->names[i]] = (int)i;
+        }
+        transitions.emplace_back(field, next);
+        return next;
+    }
+
+private:
+    static constexpr size_t kLinearSearch = 8;    // Larger shapes keep an index
+
+    std::vector<Symbol> names;
+    std::unique_ptr<std::unordered_map<Symbol, int>> index;
+    std::vector<std::pair<Symbol, Shape*>> transitions;
+
+    Shape() = default;
+};
+
+// Inline cache for one field access site: the shape last seen there and
+// the slot the field had in it
+struct FieldCache {
+    const Shape* shape = nullptr;
+    int slot = 0;
+};
@@ -5,6 +5,7 @@
 #include <functional>
 #include <cmath>
 #include <cstdlib>
+#include <cerrno>
 #include <ctime>
 #include <iostream>
 #include <fstream>
@@ -12,6 +13,8 @@
 #include <algorithm>
 #include <iomanip>
 #include <regex>
+#include <cstdint>
+#include <chrono>
 #ifdef _WIN32
     #include <windows.h>
 #else
@@ -23,7 +26,8 @@
 // Runtime Value System
 //===----------------------------------------------------------------------===//
 
-enum class ValueType {
+// Kinds from String on keep their payload in a refcounted heap cell
+enum class ValueType : uint8_t {
     Null,
     Int,
     Double,
@@ -31,34 +35,142 @@ enum class ValueType {
     String,
     Array,
     Object,
-    Lambda
+    Lambda,
+    Range
 };
 
+struct RuntimeValue;
+struct LambdaCell;
+class LambdaExprAST;
+
+// Fields of a map or object, keyed by interned name
+using FieldMap = std::unordered_map<Symbol, RuntimeValue>;
+
+struct HeapCell {
+    uint32_t refCount = 1;
+    virtual ~HeapCell() = default;
+};
+
+// Cells that hold other values (arrays, maps/objects, lambdas' captured
+// values) and so can end up in a reference cycle. The Heap keeps every
+// live one in a list.
+struct ContainerCell : HeapCell {
+    ValueType kind;
+    bool gcReachable = false;
+    uint32_t gcRefs = 0;            // Scratch count used while collecting
+    ContainerCell* gcPrev = nullptr;
+    ContainerCell* gcNext = nullptr;
+    
+    explicit ContainerCell(ValueType k);
+    ~ContainerCell() override;
+};
+
+// A tag plus an 8-byte payload: 16 bytes per value. Scalars are stored
+// inline; strings, arrays, maps/objects, lambdas and ranges point to a
+// refcounted heap cell.
+//
+// Arrays, maps and objects have reference semantics: every value holding
+// the cell sees a change made through any of them, and passing or returning
+// one is O(1). Strings and ranges are immutable.
 struct RuntimeValue {
     ValueType type = ValueType::Null;
-    
-    // Primitive values
-    long long intVal = 0;
-    double doubleVal = 0.0;
-    bool boolVal = false;
-    std::string stringVal;
-    
-    // Complex types
-    std::vector<RuntimeValue> arrayVal;
-    std::unordered_map<std::string, RuntimeValue> objectVal;
-    
-    // Lambda support
-    std::vector<std::string> lambdaParams;
-    void* lambdaBody = nullptr; // Pointer to ExprAST
+    union {
+        long long intVal = 0;
+        double doubleVal;
+        bool boolVal;
+        HeapCell* cell;
+    };
     
     // Constructors
-    RuntimeValue() : type(ValueType::Null) {}
+    RuntimeValue() {}
     RuntimeValue(int v) : type(ValueType::Int), intVal(v) {}
     RuntimeValue(long long v) : type(ValueType::Int), intVal(v) {}
     RuntimeValue(double v) : type(ValueType::Double), doubleVal(v) {}
     RuntimeValue(bool v) : type(ValueType::Bool), boolVal(v) {}
-    RuntimeValue(const std::string& v) : type(ValueType::String), stringVal(v) {}
-    RuntimeValue(const char* v) : type(ValueType::String), stringVal(v) {}
+    RuntimeValue(std::string v);
+    RuntimeValue(const char* v) : RuntimeValue(std::string(v)) {}
+    
+    static RuntimeValue newArray(std::vector<RuntimeValue> items = {});
+    static RuntimeValue newObject(const ClassAST* klass = nullptr);
+    static RuntimeValue makeLambda(LambdaExprAST* lambda, void* code, std::vector<RuntimeValue> env,
+                                   std::shared_ptr<const void> owner = nullptr);
+    static RuntimeValue makeRange(long long start, long long stop, long long step);
+    
+    // The shared, immutable string for a symbol's text. Every use of the
+    // same literal returns the same cell.
+    static RuntimeValue literal(Symbol text);
+    // The text of a map key: its literal if it has one, otherwise a new
+    // string that keeps the key (so the key is not pinned like a literal)
+    static RuntimeValue ofKey(Symbol key);
+    
+    RuntimeValue(const RuntimeValue& other) : type(other.type), intVal(other.intVal) {
+        if (isHeap()) cell->refCount++;
+    }
+    RuntimeValue(RuntimeValue&& other) noexcept : type(other.type), intVal(other.intVal) {
+        other.type = ValueType::Null;
+    }
+    RuntimeValue& operator=(const RuntimeValue& other) {
+        if (other.isHeap()) other.cell->refCount++;
+        release();
+        type = other.type;
+        intVal = other.intVal;
+        return *this;
+    }
+    RuntimeValue& operator=(RuntimeValue&& other) noexcept {
+        if (this != &other) {
+            release();
+            type = other.type;
+            intVal = other.intVal;
+            other.type = ValueType::Null;
+        }
+        return *this;
+    }
+    ~RuntimeValue() { release(); }
+    
+    bool isHeap() const { return type >= ValueType::String; }
+    
+    // Payload access. Reading the wrong kind yields an empty payload.
+    const std::string& str() const;
+    const std::vector<RuntimeValue>& array() const;
+    const ClassAST* klass() const;                  // Class of an object made with new
+    Symbol toSymbol() const;                        // As a map key; cached on string cells
+    const LambdaCell* lambda() const;               // null unless a Lambda
+    
+    // Fields of a map or instance, in whichever layout the cell keeps them.
+    // The cache variants remember the slot for one access site.
+    const RuntimeValue* findField(Symbol name) const;                   // null if absent
+    const RuntimeValue* findField(Symbol name, FieldCache& cache) const;
+    size_t fieldCount() const;
+    template <typename Visit> void forEachField(Visit visit) const;     // visit(Symbol, const RuntimeValue&)
+    
+    // Writable payload, shared with every other reference to the cell;
+    // a value of another kind is first replaced by an empty one
+    std::vector<RuntimeValue>& mutableArray();
+    RuntimeValue& field(Symbol name);                                   // Added as null if absent
+    RuntimeValue& field(Symbol name, FieldCache& cache);
+    
+    // The hash map of a map. An instance is first switched to one, which
+    // code that removes fields needs.
+    FieldMap& mutableObject();
+    
+    // A new array or map/object with the same elements (shallow copy)
+    RuntimeValue clone() const;
+    
+    // Ranges produce their values on demand and never store them
+    long long rangeSize() const;
+    long long rangeAt(long long i) const;
+    long long rangeIndexOf(long long v) const;      // Position of v, or -1
+    
+    // Arrays as they are; ranges expanded for code that needs the elements
+    RuntimeValue toArray() const;
+    
+    // A new array holding this array's or range's elements
+    RuntimeValue copyArray() const { return type == ValueType::Range ? toArray() : clone(); }
+    
+    // For builtins that return an updated container: this one when the
+    // caller's argument holds the only reference, so no one sees it change
+    RuntimeValue updatableArray() const;
+    RuntimeValue updatableObject() const;
     
     // Type conversion
     std::string toString() const {
@@ -67,7 +179,7 @@ struct RuntimeValue {
             case ValueType::Int: return std::to_string(intVal);
             case ValueType::Double: return std::to_string(doubleVal);
             case ValueType::Bool: return boolVal ? "true" : "false";
-            case ValueType::String: return stringVal;
+            case ValueType::String: return str();
             default: return "[object]";
         }
     }
@@ -76,7 +188,7 @@ struct RuntimeValue {
         switch (type) {
             case ValueType::Int: return (double)intVal;
             case ValueType::Double: return doubleVal;
-            case ValueType::String: return std::stod(stringVal);
+            case ValueType::String: return std::stod(str());
             default: return 0.0;
         }
     }
@@ -85,7 +197,7 @@ struct RuntimeValue {
         switch (type) {
             case ValueType::Int: return intVal;
             case ValueType::Double: return (long long)doubleVal;
-            case ValueType::String: return std::stoll(stringVal);
+            case ValueType::String: return std::stoll(str());
             default: return 0;
         }
     }
@@ -95,13 +207,506 @@ struct RuntimeValue {
             case ValueType::Bool: return boolVal;
             case ValueType::Int: return intVal != 0;
             case ValueType::Double: return doubleVal != 0.0;
-            case ValueType::String: return !stringVal.empty();
+            case ValueType::String: return !str().empty();
             default: return false;
         }
     }
+    
+private:
+    RuntimeValue(ValueType t, HeapCell* c) : type(t), cell(c) {}
+    
+    void release() {
+        if (isHeap() && --cell->refCount == 0) delete cell;
+    }
+};
+
+static_assert(sizeof(RuntimeValue) == 16, "RuntimeValue should stay a tag plus one word");
+
+struct StringCell : HeapCell {
+    std::string value;
+    SymbolEntry* symbol = nullptr;  // Interned copy of value, once used as a key; counted
+
+    ~StringCell() override { forgetSymbol(); }
+
+    // Called when value changes
+    void forgetSymbol() {
+        if (symbol) Symbol::release(symbol);
+        symbol = nullptr;
+    }
+};
+
+struct ArrayCell : ContainerCell {
+    std::vector<RuntimeValue> items;
+    ArrayCell() : ContainerCell(ValueType::Array) {}
+};
+
+// Maps and class instances. An instance starts with its class's shape and
+// keeps field values in slots, in shape order; maps, and instances that
+// had a field removed or grew past Shape::kMaxFields, use a hash map,
+// allocated on first use.
+struct ObjectCell : ContainerCell {
+    const ClassAST* klass = nullptr;
+    Shape* shape = nullptr;
+    std::vector<RuntimeValue> slots;
+    std::unique_ptr<FieldMap> map;
+    ObjectCell() : ContainerCell(ValueType::Object) {}
+    
+    FieldMap& fields() {
+        if (!map) map = std::make_unique<FieldMap>();
+        return *map;
+    }
+    
+    void toDictionary() {
+        FieldMap& dict = fields();
+        for (size_t i = 0; i < slots.size(); i++) dict.emplace(shape->name(i), std::move(slots[i]));
+        slots = {};
+        shape = nullptr;
+    }
+};
+
+// A closure: the lambda's resolved AST, the engine's compiled body (the
+// VM's CompiledFunction; unused by the tree-walker), and the values its
+// frame starts with -- the creating frame's self, then each capture.
+struct LambdaCell : ContainerCell {
+    LambdaExprAST* ast = nullptr;
+    void* code = nullptr;
+    std::vector<RuntimeValue> env;
+    std::shared_ptr<const void> owner;  // Keeps ast alive when its program may go first (REPL lines)
+    LambdaCell() : ContainerCell(ValueType::Lambda) {}
+};
+
+struct RangeCell : HeapCell {
+    long long start = 0;
+    long long stop = 0;
+    long long step = 1;
+};
+
+//===----------------------------------------------------------------------===//
+// Garbage Collector
+//===----------------------------------------------------------------------===//
+
+// Refcounting frees most values as soon as they are dropped; this collector
+// reclaims the rest, i.e. arrays, objects and closures that only keep each
+// other alive.
+//
+// It traces the container cells: each one's count of references from other
+// containers is subtracted from its refcount, and whatever is left comes
+// from outside the heap -- the engines' frames and operand stacks, globals,
+// native call arguments and C++ temporaries. Those cells are the roots.
+// Everything reachable from a root is kept; the remaining cells are
+// emptied, which breaks their cycles and lets refcounting free them.
+//
+// A collection runs once more containers are live than the budget allows,
+// but only at the engines' safe points (function entry and loop back
+// edges), never in the middle of a native call.
+class Heap {
+public:
+    static constexpr size_t kDefaultBudget = 100000;
+    static inline size_t budget = kDefaultBudget;   // Live containers before the first collection
+    
+    static void setBudget(size_t cells) {
+        budget = cells;
+        threshold = cells;
+    }
+    
+    static void track(ContainerCell* c) {
+        c->gcNext = head;
+        if (head) head->gcPrev = c;
+        head = c;
+        if (++live > peak) peak = live;
+    }
+    
+    static void untrack(ContainerCell* c) {
+        if (c->gcPrev) c->gcPrev->gcNext = c->gcNext;
+        else head = c->gcNext;
+        if (c->gcNext) c->gcNext->gcPrev = c->gcPrev;
+        live--;
+    }
+    
+    static void safePoint() {
+        if (live > threshold) collect();
+    }
+    
+    // Frees every unreachable container; returns how many there were
+    static size_t collect() {
+        auto started = std::chrono::steady_clock::now();
+        
+        for (ContainerCell* c = head; c; c = c->gcNext) {
+            c->gcRefs = c->refCount;
+            c->gcReachable = false;
+        }
+        for (ContainerCell* c = head; c; c = c->gcNext) {
+            forEachChild(c, [](ContainerCell* child) { child->gcRefs--; });
+        }
+        
+        // Mark
+        std::vector<ContainerCell*> pending;
+        for (ContainerCell* c = head; c; c = c->gcNext) {
+            if (c->gcRefs > 0) {
+                c->gcReachable = true;
+                pending.push_back(c);
+            }
+        }
+        while (!pending.empty()) {
+            ContainerCell* c = pending.back();
+            pending.pop_back();
+            forEachChild(c, [&pending](ContainerCell* child) {
+                if (!child->gcReachable) {
+                    child->gcReachable = true;
+                    pending.push_back(child);
+                }
+            });
+        }
+        
+        // Sweep. Holding an extra reference keeps each garbage cell alive
+        // until all of them are emptied.
+        std::vector<ContainerCell*> garbage;
+        for (ContainerCell* c = head; c; c = c->gcNext) {
+            if (!c->gcReachable) {
+                c->refCount++;
+                garbage.push_back(c);
+            }
+        }
+        for (ContainerCell* c : garbage) {
+            clearChildren(c);
+        }
+        for (ContainerCell* c : garbage) {
+            if (--c->refCount == 0) delete c;
+        }
+        
+        threshold = std::max(budget, live * 2);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+        collections++;
+        freed += garbage.size();
+        totalPauseMs += ms;
+        maxPauseMs = std::max(maxPauseMs, ms);
+        return garbage.size();
+    }
+    
+    static void printStats(std::ostream& out) {
+        out << "GC: " << collections << " collections, " << freed << " containers freed, "
+            << live << " live (peak " << peak << ", budget " << budget << ")" << std::endl;
+        out << "GC: pause total " << std::fixed << std::setprecision(3) << totalPauseMs << " ms, max "
+            << maxPauseMs << " ms, mean " << (collections ? totalPauseMs / collections : 0.0) << " ms" << std::endl;
+    }
+    
+private:
+    static inline ContainerCell* head = nullptr;
+    static inline size_t live = 0;
+    static inline size_t peak = 0;
+    static inline size_t threshold = kDefaultBudget;
+    static inline size_t collections = 0;
+    static inline size_t freed = 0;
+    static inline double totalPauseMs = 0;
+    static inline double maxPauseMs = 0;
+    
+    template <typename Visit>
+    static void forEachChild(ContainerCell* c, Visit visit) {
+        auto visitValue = [&visit](const RuntimeValue& v) {
+            if (v.type == ValueType::Array || v.type == ValueType::Object || v.type == ValueType::Lambda) {
+                visit(static_cast<ContainerCell*>(v.cell));
+            }
+        };
+        if (c->kind == ValueType::Array) {
+            for (auto& v : static_cast<ArrayCell*>(c)->items) visitValue(v);
+        } else if (c->kind == ValueType::Lambda) {
+            for (auto& v : static_cast<LambdaCell*>(c)->env) visitValue(v);
+        } else {
+            auto* o = static_cast<ObjectCell*>(c);
+            for (auto& v : o->slots) visitValue(v);
+            if (o->map) {
+                for (auto& [key, v] : *o->map) visitValue(v);
+            }
+        }
+    }
+    
+    // Moved out first so the cell is already empty while its values die
+    static void clearChildren(ContainerCell* c) {
+        if (c->kind == ValueType::Array) {
+            std::vector<RuntimeValue> items = std::move(static_cast<ArrayCell*>(c)->items);
+        } else if (c->kind == ValueType::Lambda) {
+            std::vector<RuntimeValue> env = std::move(static_cast<LambdaCell*>(c)->env);
+        } else {
+            std::vector<RuntimeValue> slots = std::move(static_cast<ObjectCell*>(c)->slots);
+            std::unique_ptr<FieldMap> map = std::move(static_cast<ObjectCell*>(c)->map);
+        }
+    }
+};
+
+inline ContainerCell::ContainerCell(ValueType k) : kind(k) {
+    Heap::track(this);
+}
+
+inline ContainerCell::~ContainerCell() {
+    Heap::untrack(this);
+}
+
+inline RuntimeValue::RuntimeValue(std::string v) : type(ValueType::String) {
+    auto* s = new StringCell();
+    s->value = std::move(v);
+    cell = s;
+}
+
+inline RuntimeValue RuntimeValue::literal(Symbol text) {
+    SymbolEntry* entry = text.get();
+    if (!entry->literal) {
+        // The entry and its literal hold each other, so neither is freed
+        auto* s = new StringCell();
+        s->value = entry->name;
+        s->symbol = entry;
+        Symbol::retain(entry);
+        entry->literal = s;
+    }
+    entry->literal->refCount++;
+    return RuntimeValue(ValueType::String, entry->literal);
+}
+
+inline RuntimeValue RuntimeValue::ofKey(Symbol key) {
+    SymbolEntry* entry = key.get();
+    if (entry->literal) return literal(key);
+    auto* s = new StringCell();
+    s->value = entry->name;
+    s->symbol = entry;
+    Symbol::retain(entry);
+    return RuntimeValue(ValueType::String, s);
+}
+
+inline RuntimeValue RuntimeValue::newArray(std::vector<RuntimeValue> items) {
+    auto* a = new ArrayCell();
+    a->items = std::move(items);
+    return RuntimeValue(ValueType::Array, a);
+}
+
+inline RuntimeValue RuntimeValue::newObject(const ClassAST* klass) {
+    auto* o = new ObjectCell();
+    o->klass = klass;
+    if (klass && klass->shape) {
+        o->shape = klass->shape;
+        o->slots.resize(o->shape->size());
+    }
+    return RuntimeValue(ValueType::Object, o);
+}
+
+inline RuntimeValue RuntimeValue::makeLambda(LambdaExprAST* lambda, void* code, std::vector<RuntimeValue> env,
+                                             std::shared_ptr<const void> owner) {
+    auto* l = new LambdaCell();
+    l->ast = lambda;
+    l->code = code;
+    l->env = std::move(env);
+    l->owner = std::move(owner);
+    return RuntimeValue(ValueType::Lambda, l);
+}
+
+inline RuntimeValue RuntimeValue::makeRange(long long start, long long stop, long long step) {
+    auto* r = new RangeCell();
+    r->start = start;
+    r->stop = stop;
+    r->step = step;
+    return RuntimeValue(ValueType::Range, r);
+}
+
+inline const std::string& RuntimeValue::str() const {
+    static const std::string empty;
+    return type == ValueType::String ? static_cast<StringCell*>(cell)->value : empty;
+}
+
+inline const std::vector<RuntimeValue>& RuntimeValue::array() const {
+    static const std::vector<RuntimeValue> empty;
+    return type == ValueType::Array ? static_cast<ArrayCell*>(cell)->items : empty;
+}
+
+inline const ClassAST* RuntimeValue::klass() const {
+    return type == ValueType::Object ? static_cast<ObjectCell*>(cell)->klass : nullptr;
+}
+
+inline Symbol RuntimeValue::toSymbol() const {
+    if (type != ValueType::String) return Symbol(toString());
+    auto* s = static_cast<StringCell*>(cell);
+    if (!s->symbol) {
+        Symbol key(s->value);
+        s->symbol = key.get();
+        Symbol::retain(s->symbol);
+        return key;
+    }
+    return Symbol(s->symbol);
+}
+
+inline const LambdaCell* RuntimeValue::lambda() const {
+    return type == ValueType::Lambda ? static_cast<LambdaCell*>(cell) : nullptr;
+}
+
+inline std::vector<RuntimeValue>& RuntimeValue::mutableArray() {
+    if (type != ValueType::Array) *this = newArray();
+    return static_cast<ArrayCell*>(cell)->items;
+}
+
+inline const RuntimeValue* RuntimeValue::findField(Symbol name) const {
+    if (type != ValueType::Object) return nullptr;
+    auto* o = static_cast<ObjectCell*>(cell);
+    if (o->shape) {
+        int slot = o->shape->find(name);
+        return slot >= 0 ? &o->slots[slot] : nullptr;
+    }
+    if (!o->map) return nullptr;
+    auto it = o->map->find(name);
+    return it != o->map->end() ? &it->second : nullptr;
+}
+
+inline const RuntimeValue* RuntimeValue::findField(Symbol name, FieldCache& cache) const {
+    if (type != ValueType::Object) return nullptr;
+    auto* o = static_cast<ObjectCell*>(cell);
+    if (!o->shape) return findField(name);
+    if (o->shape != cache.shape) {
+        int slot = o->shape->find(name);
+        if (slot < 0) return nullptr;
+        cache = {o->shape, slot};
+    }
+    return &o->slots[cache.slot];
+}
+
+inline size_t RuntimeValue::fieldCount() const {
+    if (type != ValueType::Object) return 0;
+    auto* o = static_cast<ObjectCell*>(cell);
+    if (o->shape) return o->slots.size();
+    return o->map ? o->map->size() : 0;
+}
+
+template <typename Visit>
+void RuntimeValue::forEachField(Visit visit) const {
+    if (type != ValueType::Object) return;
+    auto* o = static_cast<ObjectCell*>(cell);
+    for (size_t i = 0; i < o->slots.size(); i++) visit(o->shape->name(i), o->slots[i]);
+    if (!o->map) return;
+    for (const auto& [key, value] : *o->map) visit(key, value);
+}
+
+inline RuntimeValue& RuntimeValue::field(Symbol name) {
+    if (type != ValueType::Object) *this = newObject();
+    auto* o = static_cast<ObjectCell*>(cell);
+    if (o->shape) {
+        int slot = o->shape->find(name);
+        if (slot >= 0) return o->slots[slot];
+        if (Shape* next = o->shape->withField(name)) {
+            o->shape = next;
+            return o->slots.emplace_back();
+        }
+        o->toDictionary();
+    }
+    return o->fields()[name];
+}
+
+inline RuntimeValue& RuntimeValue::field(Symbol name, FieldCache& cache) {
+    if (type == ValueType::Object) {
+        auto* o = static_cast<ObjectCell*>(cell);
+        if (o->shape && o->shape == cache.shape) return o->slots[cache.slot];
+    }
+    RuntimeValue& value = field(name);
+    auto* o = static_cast<ObjectCell*>(cell);
+    if (o->shape) cache = {o->shape, (int)(&value - o->slots.data())};
+    return value;
+}
+
+inline FieldMap& RuntimeValue::mutableObject() {
+    if (type != ValueType::Object) *this = newObject();
+    auto* o = static_cast<ObjectCell*>(cell);
+    if (o->shape) o->toDictionary();
+    return o->fields();
+}
+
+inline RuntimeValue RuntimeValue::clone() const {
+    if (type == ValueType::Array) return newArray(array());
+    if (type == ValueType::Object) {
+        auto* o = static_cast<ObjectCell*>(cell);
+        RuntimeValue copy = newObject(o->klass);
+        auto* c = static_cast<ObjectCell*>(copy.cell);
+        c->shape = o->shape;
+        c->slots = o->slots;
+        if (o->map) c->map = std::make_unique<FieldMap>(*o->map);
+        return copy;
+    }
+    return *this;
+}
+
+inline RuntimeValue RuntimeValue::updatableArray() const {
+    if (type == ValueType::Array && cell->refCount == 1) return *this;
+    return copyArray();
+}
+
+inline RuntimeValue RuntimeValue::updatableObject() const {
+    if (type == ValueType::Object && cell->refCount == 1) return *this;
+    return clone();
+}
+
+inline long long RuntimeValue::rangeSize() const {
+    if (type != ValueType::Range) return 0;
+    auto* r = static_cast<RangeCell*>(cell);
+    if (r->step > 0 && r->start < r->stop) return (r->stop - r->start - 1) / r->step + 1;
+    if (r->step < 0 && r->start > r->stop) return (r->start - r->stop - 1) / -r->step + 1;
+    return 0;
+}
+
+inline long long RuntimeValue::rangeAt(long long i) const {
+    auto* r = static_cast<RangeCell*>(cell);
+    return r->start + i * r->step;
+}
+
+inline long long RuntimeValue::rangeIndexOf(long long v) const {
+    if (type != ValueType::Range) return -1;
+    auto* r = static_cast<RangeCell*>(cell);
+    if (r->step == 0 || (v - r->start) % r->step != 0) return -1;
+    long long i = (v - r->start) / r->step;
+    return i >= 0 && i < rangeSize() ? i : -1;
+}
+
+inline RuntimeValue RuntimeValue::toArray() const {
+    if (type != ValueType::Range) return *this;
+    std::vector<RuntimeValue> items;
+    long long n = rangeSize();
+    items.reserve(n);
+    for (long long i = 0; i < n; i++) {
+        items.push_back(RuntimeValue(rangeAt(i)));
+    }
+    return newArray(std::move(items));
+}
+
+// Error raised by Omni code (throw, unknown function, ...); catchable from Omni.
+struct OmniException : public std::exception {
+    std::string message;
+    int line;
+    OmniException(const std::string& msg, int l = 0) : message(msg), line(l) {}
+    const char* what() const noexcept override { return message.c_str(); }
 };
 
-using NativeFunc = std::function<RuntimeValue(const std::vector<RuntimeValue>&)>;
+//===----------------------------------------------------------------------===//
+// Callbacks
+//===----------------------------------------------------------------------===//
+
+// How builtins such as List.map call a lambda. The running engine installs
+// itself for the length of a run; a call re-enters it with the lambda's
+// body as resolved (and, in the VM, compiled) when the lambda was made.
+class LambdaCaller {
+public:
+    virtual ~LambdaCaller() = default;
+    
+    // Calls fn with argc arguments, which it may move from. Raises an
+    // OmniException when fn is not a lambda taking argc parameters.
+    virtual RuntimeValue callLambda(const RuntimeValue& fn, RuntimeValue* args, int argc) = 0;
+    
+    static RuntimeValue call(const RuntimeValue& fn, RuntimeValue* args, int argc) {
+        if (!current) throw OmniException("Lambdas can only be called while a program runs");
+        return current->callLambda(fn, args, argc);
+    }
+    
+    // Installs an engine until the end of the scope
+    struct Scope {
+        LambdaCaller* saved;
+        explicit Scope(LambdaCaller* caller) : saved(current) { current = caller; }
+        ~Scope() { current = saved; }
+    };
+    
+private:
+    static inline LambdaCaller* current = nullptr;
+};
 
 //===----------------------------------------------------------------------===//
 // Built-in Functions Registry
@@ -131,7 +736,7 @@ public:
             
             funcs["printf"] = [](const std::vector<RuntimeValue>& args) {
                 if (args.empty()) return RuntimeValue();
-                std::string fmt = args[0].stringVal;
+                std::string fmt = args[0].str();
                 size_t argIdx = 1;
                 std::string result;
                 for (size_t i = 0; i < fmt.length(); i++) {
@@ -249,15 +854,17 @@ public:
             // ===== String Functions =====
             funcs["len"] = [](const std::vector<RuntimeValue>& args) {
                 if (args[0].type == ValueType::String)
-                    return RuntimeValue((long long)args[0].stringVal.length());
+                    return RuntimeValue((long long)args[0].str().length());
                 if (args[0].type == ValueType::Array)
-                    return RuntimeValue((long long)args[0].arrayVal.size());
+                    return RuntimeValue((long long)args[0].array().size());
+                if (args[0].type == ValueType::Range)
+                    return RuntimeValue(args[0].rangeSize());
                 return RuntimeValue(0LL);
             };
             
             funcs["String.length"] = [](const std::vector<RuntimeValue>& args) {
                 if (args.empty()) return RuntimeValue(0LL);
-                return RuntimeValue((long long)args[0].stringVal.length());
+                return RuntimeValue((long long)args[0].str().length());
             };
             
             funcs["str"] = [](const std::vector<RuntimeValue>& args) {
@@ -273,19 +880,19 @@ public:
             };
             
             funcs["String.toUpperCase"] = [](const std::vector<RuntimeValue>& args) {
-                std::string s = args[0].stringVal;
+                std::string s = args[0].str();
                 std::transform(s.begin(), s.end(), s.begin(), ::toupper);
                 return RuntimeValue(s);
             };
             
             funcs["String.toLowerCase"] = [](const std::vector<RuntimeValue>& args) {
-                std::string s = args[0].stringVal;
+                std::string s = args[0].str();
                 std::transform(s.begin(), s.end(), s.begin(), ::tolower);
                 return RuntimeValue(s);
             };
             
             funcs["String.substring"] = [](const std::vector<RuntimeValue>& args) {
-                std::string s = args[0].stringVal;
+                std::string s = args[0].str();
                 int start = (int)args[1].toInt();
                 if (args.size() > 2) {
                     int end = (int)args[2].toInt();
@@ -295,29 +902,29 @@ public:
             };
             
             funcs["String.indexOf"] = [](const std::vector<RuntimeValue>& args) {
-                size_t pos = args[0].stringVal.find(args[1].stringVal);
+                size_t pos = args[0].str().find(args[1].str());
                 return RuntimeValue(pos == std::string::npos ? -1LL : (long long)pos);
             };
             
             funcs["String.contains"] = [](const std::vector<RuntimeValue>& args) {
-                return RuntimeValue(args[0].stringVal.find(args[1].stringVal) != std::string::npos);
+                return RuntimeValue(args[0].str().find(args[1].str()) != std::string::npos);
             };
             
             funcs["String.startsWith"] = [](const std::vector<RuntimeValue>& args) {
-                return RuntimeValue(args[0].stringVal.rfind(args[1].stringVal, 0) == 0);
+                return RuntimeValue(args[0].str().rfind(args[1].str(), 0) == 0);
             };
             
             funcs["String.endsWith"] = [](const std::vector<RuntimeValue>& args) {
-                const std::string& s = args[0].stringVal;
-                const std::string& suffix = args[1].stringVal;
+                const std::string& s = args[0].str();
+                const std::string& suffix = args[1].str();
                 if (suffix.size() > s.size()) return RuntimeValue(false);
                 return RuntimeValue(s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0);
             };
             
             funcs["String.replace"] = [](const std::vector<RuntimeValue>& args) {
-                std::string s = args[0].stringVal;
-                const std::string& from = args[1].stringVal;
-                const std::string& to = args[2].stringVal;
+                std::string s = args[0].str();
+                const std::string& from = args[1].str();
+                const std::string& to = args[2].str();
                 size_t pos = 0;
                 while ((pos = s.find(from, pos)) != std::string::npos) {
                     s.replace(pos, from.length(), to);
@@ -327,37 +934,36 @@ public:
             };
             
             funcs["String.trim"] = [](const std::vector<RuntimeValue>& args) {
-                std::string s = args[0].stringVal;
+                std::string s = args[0].str();
                 s.erase(0, s.find_first_not_of(" \t\n\r"));
                 s.erase(s.find_last_not_of(" \t\n\r") + 1);
                 return RuntimeValue(s);
             };
             
             funcs["String.split"] = [](const std::vector<RuntimeValue>& args) {
-                RuntimeValue result;
-                result.type = ValueType::Array;
-                std::string s = args[0].stringVal;
-                std::string delim = args.size() > 1 ? args[1].stringVal : " ";
+                RuntimeValue result = RuntimeValue::newArray();
+                std::string s = args[0].str();
+                std::string delim = args.size() > 1 ? args[1].str() : " ";
                 size_t pos = 0;
                 while ((pos = s.find(delim)) != std::string::npos) {
-                    result.arrayVal.push_back(RuntimeValue(s.substr(0, pos)));
+                    result.mutableArray().push_back(RuntimeValue(s.substr(0, pos)));
                     s.erase(0, pos + delim.length());
                 }
-                result.arrayVal.push_back(RuntimeValue(s));
+                result.mutableArray().push_back(RuntimeValue(s));
                 return result;
             };
             
             funcs["String.charAt"] = [](const std::vector<RuntimeValue>& args) {
                 int idx = (int)args[1].toInt();
-                if (idx >= 0 && idx < (int)args[0].stringVal.length()) {
-                    return RuntimeValue(std::string(1, args[0].stringVal[idx]));
+                if (idx >= 0 && idx < (int)args[0].str().length()) {
+                    return RuntimeValue(std::string(1, args[0].str()[idx]));
                 }
                 return RuntimeValue("");
             };
             
             // ===== File IO =====
             funcs["File.read"] = [](const std::vector<RuntimeValue>& args) {
-                std::ifstream file(args[0].stringVal);
+                std::ifstream file(args[0].str());
                 if (!file.is_open()) return RuntimeValue("");
                 std::stringstream buffer;
                 buffer << file.rdbuf();
@@ -365,28 +971,27 @@ public:
             };
             
             funcs["File.write"] = [](const std::vector<RuntimeValue>& args) {
-                std::ofstream file(args[0].stringVal);
+                std::ofstream file(args[0].str());
                 if (!file.is_open()) return RuntimeValue(false);
-                file << args[1].stringVal;
+                file << args[1].str();
                 return RuntimeValue(true);
             };
             
             funcs["File.append"] = [](const std::vector<RuntimeValue>& args) {
-                std::ofstream file(args[0].stringVal, std::ios::app);
+                std::ofstream file(args[0].str(), std::ios::app);
                 if (!file.is_open()) return RuntimeValue(false);
-                file << args[1].stringVal;
+                file << args[1].str();
                 return RuntimeValue(true);
             };
             
             funcs["File.exists"] = [](const std::vector<RuntimeValue>& args) {
-                std::ifstream file(args[0].stringVal);
+                std::ifstream file(args[0].str());
                 return RuntimeValue(file.good());
             };
             
             // ===== Array/List Functions =====
             funcs["range"] = [](const std::vector<RuntimeValue>& args) {
-                RuntimeValue result;
-                result.type = ValueType::Array;
+                // Lazy: len, indexing and for loops never build the array
                 long long start = 0, end = 0, step = 1;
                 if (args.size() == 1) {
                     end = args[0].toInt();
@@ -397,77 +1002,75 @@ public:
                 if (args.size() >= 3) {
                     step = args[2].toInt();
                 }
-                for (long long i = start; i < end; i += step) {
-                    result.arrayVal.push_back(RuntimeValue(i));
-                }
-                return result;
+                return RuntimeValue::makeRange(start, end, step);
             };
             
             // ===== Type Checking =====
             funcs["typeof"] = [](const std::vector<RuntimeValue>& args) {
-                switch (args[0].type) {
-                    case ValueType::Int: return RuntimeValue("int");
-                    case ValueType::Double: return RuntimeValue("double");
-                    case ValueType::Bool: return RuntimeValue("bool");
-                    case ValueType::String: return RuntimeValue("string");
-                    case ValueType::Array: return RuntimeValue("array");
-                    case ValueType::Object: return RuntimeValue("object");
-                    default: return RuntimeValue("null");
-                }
+                return RuntimeValue(typeName(args[0].type));
             };
             
             // ===== List/ArrayList Functions =====
             funcs["List.new"] = [](const std::vector<RuntimeValue>&) {
-                RuntimeValue result;
-                result.type = ValueType::Array;
+                RuntimeValue result = RuntimeValue::newArray();
                 return result;
             };
             
             funcs["List.add"] = [](const std::vector<RuntimeValue>& args) {
                 // Returns new list with element added (immutable style)
-                RuntimeValue result = args[0];
-                result.arrayVal.push_back(args[1]);
+                RuntimeValue result = args[0].updatableArray();
+                result.mutableArray().push_back(args[1]);
                 return result;
             };
             
             funcs["List.get"] = [](const std::vector<RuntimeValue>& args) {
                 int idx = (int)args[1].toInt();
-                if (idx >= 0 && idx < (int)args[0].arrayVal.size()) {
-                    return args[0].arrayVal[idx];
+                if (args[0].type == ValueType::Range) {
+                    if (idx >= 0 && idx < args[0].rangeSize()) return RuntimeValue(args[0].rangeAt(idx));
+                    return RuntimeValue();
+                }
+                if (idx >= 0 && idx < (int)args[0].array().size()) {
+                    return args[0].array()[idx];
                 }
                 return RuntimeValue();
             };
             
             funcs["List.set"] = [](const std::vector<RuntimeValue>& args) {
-                RuntimeValue result = args[0];
-                int idx = (int)args[1].toInt();
-                if (idx >= 0 && idx < (int)result.arrayVal.size()) {
-                    result.arrayVal[idx] = args[2];
+                RuntimeValue result = args[0].updatableArray();
+                int idx = (int)updateIndex(args[1]);
+                if (idx >= 0 && idx < (int)result.array().size()) {
+                    result.mutableArray()[idx] = args[2];
                 }
                 return result;
             };
             
             funcs["List.size"] = [](const std::vector<RuntimeValue>& args) {
-                return RuntimeValue((long long)args[0].arrayVal.size());
+                if (args[0].type == ValueType::Range) return RuntimeValue(args[0].rangeSize());
+                return RuntimeValue((long long)args[0].array().size());
             };
             
             funcs["List.isEmpty"] = [](const std::vector<RuntimeValue>& args) {
-                return RuntimeValue(args[0].arrayVal.empty());
+                if (args[0].type == ValueType::Range) return RuntimeValue(args[0].rangeSize() == 0);
+                return RuntimeValue(args[0].array().empty());
             };
             
             funcs["List.remove"] = [](const std::vector<RuntimeValue>& args) {
-                RuntimeValue result = args[0];
-                int idx = (int)args[1].toInt();
-                if (idx >= 0 && idx < (int)result.arrayVal.size()) {
-                    result.arrayVal.erase(result.arrayVal.begin() + idx);
+                RuntimeValue result = args[0].updatableArray();
+                int idx = (int)updateIndex(args[1]);
+                if (idx >= 0 && idx < (int)result.array().size()) {
+                    auto& items = result.mutableArray();
+                    items.erase(items.begin() + idx);
                 }
                 return result;
             };
             
             funcs["List.contains"] = [](const std::vector<RuntimeValue>& args) {
-                for (const auto& item : args[0].arrayVal) {
+                if (args[0].type == ValueType::Range) {
+                    return RuntimeValue(args[1].type == ValueType::Int && args[0].rangeIndexOf(args[1].intVal) >= 0);
+                }
+                for (const auto& item : args[0].array()) {
                     if (item.type == args[1].type) {
-                        if (item.type == ValueType::String && item.stringVal == args[1].stringVal) return RuntimeValue(true);
+                        if (item.type == ValueType::String && item.str() == args[1].str()) return RuntimeValue(true);
                         if (item.type == ValueType::Int && item.intVal == args[1].intVal) return RuntimeValue(true);
                         if (item.type == ValueType::Double && item.doubleVal == args[1].doubleVal) return RuntimeValue(true);
                     }
@@ -475,11 +1078,69 @@ public:
                 return RuntimeValue(false);
             };
             
+            // ===== Higher-order List Functions =====
+            // The callback may change the list, so each element is fetched
+            // afresh and the result is always a new list.
+            funcs["List.map"] = [](const std::vector<RuntimeValue>& args) {
+                RuntimeValue list = args[0].toArray();
+                std::vector<RuntimeValue> result;
+                result.reserve(list.array().size());
+                for (size_t i = 0; i < list.array().size(); i++) {
+                    RuntimeValue item = list.array()[i];
+                    result.push_back(LambdaCaller::call(args[1], &item, 1));
+                }
+                return RuntimeValue::newArray(std::move(result));
+            };
+            
+            funcs["List.filter"] = [](const std::vector<RuntimeValue>& args) {
+                RuntimeValue list = args[0].toArray();
+                std::vector<RuntimeValue> result;
+                for (size_t i = 0; i < list.array().size(); i++) {
+                    RuntimeValue item = list.array()[i];
+                    RuntimeValue arg = item;
+                    if (LambdaCaller::call(args[1], &arg, 1).toBool()) result.push_back(std::move(item));
+                }
+                return RuntimeValue::newArray(std::move(result));
+            };
+            
+            // List.reduce(list, (acc, x) -> ..., initial)
+            funcs["List.reduce"] = [](const std::vector<RuntimeValue>& args) {
+                RuntimeValue list = args[0].toArray();
+                RuntimeValue acc = args.size() > 2 ? args[2] : RuntimeValue();
+                for (size_t i = 0; i < list.array().size(); i++) {
+                    RuntimeValue pair[2] = {std::move(acc), list.array()[i]};
+                    acc = LambdaCaller::call(args[1], pair, 2);
+                }
+                return acc;
+            };
+            
+            // Stable; the key of each element is computed once
+            funcs["List.sortBy"] = [](const std::vector<RuntimeValue>& args) {
+                RuntimeValue list = args[0].toArray();
+                std::vector<std::pair<RuntimeValue, RuntimeValue>> keyed;
+                keyed.reserve(list.array().size());
+                for (size_t i = 0; i < list.array().size(); i++) {
+                    RuntimeValue item = list.array()[i];
+                    RuntimeValue arg = item;
+                    keyed.emplace_back(LambdaCaller::call(args[1], &arg, 1), std::move(item));
+                }
+                std::stable_sort(keyed.begin(), keyed.end(), [](const auto& a, const auto& b) {
+                    return keyLess(a.first, b.first);
+                });
+                std::vector<RuntimeValue> result;
+                result.reserve(keyed.size());
+                for (auto& entry : keyed) result.push_back(std::move(entry.second));
+                return RuntimeValue::newArray(std::move(result));
+            };
+            
             funcs["List.indexOf"] = [](const std::vector<RuntimeValue>& args) {
-                for (size_t i = 0; i < args[0].arrayVal.size(); i++) {
-                    const auto& item = args[0].arrayVal[i];
+                if (args[0].type == ValueType::Range) {
+                    return RuntimeValue(args[1].type == ValueType::Int ? args[0].rangeIndexOf(args[1].intVal) : -1LL);
+                }
+                for (size_t i = 0; i < args[0].array().size(); i++) {
+                    const auto& item = args[0].array()[i];
                     if (item.type == args[1].type) {
-                        if (item.type == ValueType::String && item.stringVal == args[1].stringVal) return RuntimeValue((long long)i);
+                        if (item.type == ValueType::String && item.str() == args[1].str()) return RuntimeValue((long long)i);
                         if (item.type == ValueType::Int && item.intVal == args[1].intVal) return RuntimeValue((long long)i);
                     }
                 }
@@ -488,47 +1149,42 @@ public:
             
             // ===== Map/HashMap Functions =====
             funcs["Map.new"] = [](const std::vector<RuntimeValue>&) {
-                RuntimeValue result;
-                result.type = ValueType::Object;
+                RuntimeValue result = RuntimeValue::newObject();
                 return result;
             };
             
             funcs["Map.put"] = [](const std::vector<RuntimeValue>& args) {
-                RuntimeValue result = args[0];
-                result.objectVal[args[1].toString()] = args[2];
+                RuntimeValue result = args[0].updatableObject();
+                result.field(args[1].toSymbol()) = args[2];
                 return result;
             };
             
             funcs["Map.get"] = [](const std::vector<RuntimeValue>& args) {
-                std::string key = args[1].toString();
-                if (args[0].objectVal.count(key)) {
-                    return args[0].objectVal.at(key);
-                }
-                return RuntimeValue();
+                const RuntimeValue* value = args[0].findField(args[1].toSymbol());
+                return value ? *value : RuntimeValue();
             };
             
             funcs["Map.containsKey"] = [](const std::vector<RuntimeValue>& args) {
-                return RuntimeValue(args[0].objectVal.count(args[1].toString()) > 0);
+                return RuntimeValue(args[0].findField(args[1].toSymbol()) != nullptr);
             };
             
             funcs["Map.keys"] = [](const std::vector<RuntimeValue>& args) {
-                RuntimeValue result;
-                result.type = ValueType::Array;
-                for (const auto& kv : args[0].objectVal) {
-                    result.arrayVal.push_back(RuntimeValue(kv.first));
-                }
+                RuntimeValue result = RuntimeValue::newArray();
+                args[0].forEachField([&result](Symbol key, const RuntimeValue&) {
+                    result.mutableArray().push_back(RuntimeValue::ofKey(key));
+                });
                 return result;
             };
             
             funcs["Map.size"] = [](const std::vector<RuntimeValue>& args) {
-                return RuntimeValue((long long)args[0].objectVal.size());
+                return RuntimeValue((long long)args[0].fieldCount());
             };
             
             // ===== Regex Functions (Full std::regex support) =====
             funcs["Regex.matches"] = [](const std::vector<RuntimeValue>& args) {
                 try {
-                    std::string str = args[0].stringVal;
-                    std::string pattern = args[1].stringVal;
+                    std::string str = args[0].str();
+                    std::string pattern = args[1].str();
                     std::regex re(pattern);
                     return RuntimeValue(std::regex_match(str, re));
                 } catch (...) {
@@ -538,8 +1194,8 @@ public:
             
             funcs["Regex.search"] = [](const std::vector<RuntimeValue>& args) {
                 try {
-                    std::string str = args[0].stringVal;
-                    std::string pattern = args[1].stringVal;
+                    std::string str = args[0].str();
+                    std::string pattern = args[1].str();
                     std::regex re(pattern);
                     return RuntimeValue(std::regex_search(str, re));
                 } catch (...) {
@@ -549,8 +1205,8 @@ public:
             
             funcs["Regex.find"] = [](const std::vector<RuntimeValue>& args) {
                 try {
-                    std::string str = args[0].stringVal;
-                    std::string pattern = args[1].stringVal;
+                    std::string str = args[0].str();
+                    std::string pattern = args[1].str();
                     std::regex re(pattern);
                     std::smatch match;
                     if (std::regex_search(str, match, re)) {
@@ -563,18 +1219,17 @@ public:
             };
             
             funcs["Regex.findAll"] = [](const std::vector<RuntimeValue>& args) {
-                RuntimeValue result;
-                result.type = ValueType::Array;
+                RuntimeValue result = RuntimeValue::newArray();
                 try {
-                    std::string str = args[0].stringVal;
-                    std::string pattern = args[1].stringVal;
+                    std::string str = args[0].str();
+                    std::string pattern = args[1].str();
                     std::regex re(pattern);
                     
                     auto begin = std::sregex_iterator(str.begin(), str.end(), re);
                     auto end = std::sregex_iterator();
                     
                     for (auto it = begin; it != end; ++it) {
-                        result.arrayVal.push_back(RuntimeValue(it->str()));
+                        result.mutableArray().push_back(RuntimeValue(it->str()));
                     }
                 } catch (...) {}
                 return result;
@@ -582,48 +1237,46 @@ public:
             
             funcs["Regex.replace"] = [](const std::vector<RuntimeValue>& args) {
                 try {
-                    std::string str = args[0].stringVal;
-                    std::string pattern = args[1].stringVal;
-                    std::string replacement = args[2].stringVal;
+                    std::string str = args[0].str();
+                    std::string pattern = args[1].str();
+                    std::string replacement = args[2].str();
                     std::regex re(pattern);
                     return RuntimeValue(std::regex_replace(str, re, replacement));
                 } catch (...) {
-                    return RuntimeValue(args[0].stringVal);
+                    return RuntimeValue(args[0].str());
                 }
             };
             
             funcs["Regex.split"] = [](const std::vector<RuntimeValue>& args) {
-                RuntimeValue result;
-                result.type = ValueType::Array;
+                RuntimeValue result = RuntimeValue::newArray();
                 try {
-                    std::string str = args[0].stringVal;
-                    std::string pattern = args[1].stringVal;
+                    std::string str = args[0].str();
+                    std::string pattern = args[1].str();
                     std::regex re(pattern);
                     
                     std::sregex_token_iterator it(str.begin(), str.end(), re, -1);
                     std::sregex_token_iterator end;
                     
                     for (; it != end; ++it) {
-                        result.arrayVal.push_back(RuntimeValue(it->str()));
+                        result.mutableArray().push_back(RuntimeValue(it->str()));
                     }
                 } catch (...) {
-                    result.arrayVal.push_back(RuntimeValue(args[0].stringVal));
+                    result.mutableArray().push_back(RuntimeValue(args[0].str()));
                 }
                 return result;
             };
             
             funcs["Regex.groups"] = [](const std::vector<RuntimeValue>& args) {
-                RuntimeValue result;
-                result.type = ValueType::Array;
+                RuntimeValue result = RuntimeValue::newArray();
                 try {
-                    std::string str = args[0].stringVal;
-                    std::string pattern = args[1].stringVal;
+                    std::string str = args[0].str();
+                    std::string pattern = args[1].str();
                     std::regex re(pattern);
                     std::smatch match;
                     
                     if (std::regex_search(str, match, re)) {
                         for (size_t i = 0; i < match.size(); ++i) {
-                            result.arrayVal.push_back(RuntimeValue(match[i].str()));
+                            result.mutableArray().push_back(RuntimeValue(match[i].str()));
                         }
                     }
                 } catch (...) {}
@@ -637,7 +1290,7 @@ public:
             
             funcs["Date.format"] = [](const std::vector<RuntimeValue>& args) {
                 time_t timestamp = (time_t)args[0].toInt();
-                std::string format = args.size() > 1 ? args[1].stringVal : "%d/%m/%Y";
+                std::string format = args.size() > 1 ? args[1].str() : "%d/%m/%Y";
                 
                 // Convert format from Java style to C style
                 std::string cFormat = format;
@@ -656,8 +1309,8 @@ public:
             };
             
             funcs["Date.parse"] = [](const std::vector<RuntimeValue>& args) {
-                std::string dateStr = args[0].stringVal;
-                std::string format = args.size() > 1 ? args[1].stringVal : "dd/MM/yyyy";
+                std::string dateStr = args[0].str();
+                std::string format = args.size() > 1 ? args[1].str() : "dd/MM/yyyy";
                 
                 // Simple dd/MM/yyyy parsing
                 if (dateStr.length() >= 10) {
@@ -701,7 +1354,7 @@ public:
             // ===== String.format (Java-style) =====
             funcs["String.format"] = [](const std::vector<RuntimeValue>& args) {
                 if (args.empty()) return RuntimeValue("");
-                std::string format = args[0].stringVal;
+                std::string format = args[0].str();
                 std::string result;
                 size_t argIdx = 1;
                 
@@ -782,44 +1435,39 @@ public:
             
             // ===== CSV Functions =====
             funcs["CSV.parse"] = [](const std::vector<RuntimeValue>& args) {
-                RuntimeValue result;
-                result.type = ValueType::Array;
-                std::string content = args[0].stringVal;
-                std::string delim = args.size() > 1 ? args[1].stringVal : ",";
+                RuntimeValue result = RuntimeValue::newArray();
+                std::string content = args[0].str();
+                std::string delim = args.size() > 1 ? args[1].str() : ",";
                 
                 std::istringstream stream(content);
                 std::string line;
                 while (std::getline(stream, line)) {
-                    RuntimeValue row;
-                    row.type = ValueType::Array;
+                    RuntimeValue row = RuntimeValue::newArray();
                     
                     size_t pos = 0;
                     while ((pos = line.find(delim)) != std::string::npos) {
-                        row.arrayVal.push_back(RuntimeValue(line.substr(0, pos)));
+                        row.mutableArray().push_back(RuntimeValue(line.substr(0, pos)));
                         line.erase(0, pos + delim.length());
                     }
-                    row.arrayVal.push_back(RuntimeValue(line));
-                    result.arrayVal.push_back(row);
+                    row.mutableArray().push_back(RuntimeValue(line));
+                    result.mutableArray().push_back(row);
                 }
                 return result;
             };
             
             funcs["CSV.readFile"] = [](const std::vector<RuntimeValue>& args) {
-                std::ifstream file(args[0].stringVal);
+                std::ifstream file(args[0].str());
                 if (!file.is_open()) {
-                    RuntimeValue empty;
-                    empty.type = ValueType::Array;
+                    RuntimeValue empty = RuntimeValue::newArray();
                     return empty;
                 }
                 
-                RuntimeValue result;
-                result.type = ValueType::Array;
-                std::string delim = args.size() > 1 ? args[1].stringVal : ",";
+                RuntimeValue result = RuntimeValue::newArray();
+                std::string delim = args.size() > 1 ? args[1].str() : ",";
                 
                 std::string line;
                 while (std::getline(file, line)) {
-                    RuntimeValue row;
-                    row.type = ValueType::Array;
+                    RuntimeValue row = RuntimeValue::newArray();
                     
                     size_t pos = 0;
                     while ((pos = line.find(delim)) != std::string::npos) {
@@ -827,14 +1475,14 @@ public:
                         // Trim whitespace
                         cell.erase(0, cell.find_first_not_of(" \t"));
                         cell.erase(cell.find_last_not_of(" \t") + 1);
-                        row.arrayVal.push_back(RuntimeValue(cell));
+                        row.mutableArray().push_back(RuntimeValue(cell));
                         line.erase(0, pos + delim.length());
                     }
                     // Last cell
                     line.erase(0, line.find_first_not_of(" \t"));
                     line.erase(line.find_last_not_of(" \t") + 1);
-                    row.arrayVal.push_back(RuntimeValue(line));
-                    result.arrayVal.push_back(row);
+                    row.mutableArray().push_back(RuntimeValue(line));
+                    result.mutableArray().push_back(row);
                 }
                 return result;
             };
@@ -842,7 +1490,7 @@ public:
             // ===== Integer/Number Parse =====
             funcs["Integer.parseInt"] = [](const std::vector<RuntimeValue>& args) {
                 try {
-                    return RuntimeValue(std::stoll(args[0].stringVal));
+                    return RuntimeValue(std::stoll(args[0].str()));
                 } catch (...) {
                     return RuntimeValue(0LL);
                 }
@@ -850,7 +1498,7 @@ public:
             
             funcs["Double.parseDouble"] = [](const std::vector<RuntimeValue>& args) {
                 try {
-                    return RuntimeValue(std::stod(args[0].stringVal));
+                    return RuntimeValue(std::stod(args[0].str()));
                 } catch (...) {
                     return RuntimeValue(0.0);
                 }
@@ -858,16 +1506,16 @@ public:
             
             // ===== isEmpty for strings =====
             funcs["String.isEmpty"] = [](const std::vector<RuntimeValue>& args) {
-                return RuntimeValue(args[0].stringVal.empty());
+                return RuntimeValue(args[0].str().empty());
             };
             
             funcs["String.equals"] = [](const std::vector<RuntimeValue>& args) {
-                return RuntimeValue(args[0].stringVal == args[1].stringVal);
+                return RuntimeValue(args[0].str() == args[1].str());
             };
             
             funcs["String.equalsIgnoreCase"] = [](const std::vector<RuntimeValue>& args) {
-                std::string s1 = args[0].stringVal;
-                std::string s2 = args[1].stringVal;
+                std::string s1 = args[0].str();
+                std::string s2 = args[1].str();
                 std::transform(s1.begin(), s1.end(), s1.begin(), ::tolower);
                 std::transform(s2.begin(), s2.end(), s2.begin(), ::tolower);
                 return RuntimeValue(s1 == s2);
@@ -883,16 +1531,17 @@ public:
                     
                     switch (val.type) {
                         case ValueType::Null: return "null";
+                        case ValueType::Range: return toJson(val.toArray(), indent);
                         case ValueType::Bool: return val.boolVal ? "true" : "false";
                         case ValueType::Int: return std::to_string(val.intVal);
                         case ValueType::Double: return std::to_string(val.doubleVal);
                         case ValueType::String: 
-                            return "\"" + val.stringVal + "\"";
+                            return "\"" + val.str() + "\"";
                         case ValueType::Array: {
                             std::string result = "[\n";
-                            for (size_t i = 0; i < val.arrayVal.size(); ++i) {
-                                result += spaces + "  " + toJson(val.arrayVal[i], indent + 1);
-                                if (i < val.arrayVal.size() - 1) result += ",";
+                            for (size_t i = 0; i < val.array().size(); ++i) {
+                                result += spaces + "  " + toJson(val.array()[i], indent + 1);
+                                if (i < val.array().size() - 1) result += ",";
                                 result += "\n";
                             }
                             return result + spaces + "]";
@@ -900,11 +1549,12 @@ public:
                         case ValueType::Object: {
                             std::string result = "{\n";
                             size_t count = 0;
-                            for (const auto& kv : val.objectVal) {
-                                result += spaces + "  \"" + kv.first + "\": " + toJson(kv.second, indent + 1);
-                                if (++count < val.objectVal.size()) result += ",";
+                            size_t total = val.fieldCount();
+                            val.forEachField([&](Symbol key, const RuntimeValue& value) {
+                                result += spaces + "  \"" + key.str() + "\": " + toJson(value, indent + 1);
+                                if (++count < total) result += ",";
                                 result += "\n";
-                            }
+                            });
                             return result + spaces + "}";
                         }
                         default: return "null";
@@ -915,7 +1565,7 @@ public:
             
             // Parse JSON string to object
             funcs["Serializer.fromJSON"] = [](const std::vector<RuntimeValue>& args) {
-                std::string json = args[0].stringVal;
+                std::string json = args[0].str();
                 // Simple JSON parser - for basic use cases
                 // Trim whitespace
                 auto trim = [](std::string& s) {
@@ -953,13 +1603,12 @@ public:
                     }
                     
                     if (s[pos] == '[') {
-                        RuntimeValue arr;
-                        arr.type = ValueType::Array;
+                        RuntimeValue arr = RuntimeValue::newArray();
                         pos++;
                         while (pos < s.length() && s[pos] != ']') {
                             while (pos < s.length() && std::isspace(s[pos])) pos++;
                             if (s[pos] == ']') break;
-                            arr.arrayVal.push_back(parse(s, pos));
+                            arr.mutableArray().push_back(parse(s, pos));
                             while (pos < s.length() && std::isspace(s[pos])) pos++;
                             if (s[pos] == ',') pos++;
                         }
@@ -968,8 +1617,7 @@ public:
                     }
                     
                     if (s[pos] == '{') {
-                        RuntimeValue obj;
-                        obj.type = ValueType::Object;
+                        RuntimeValue obj = RuntimeValue::newObject();
                         pos++;
                         while (pos < s.length() && s[pos] != '}') {
                             while (pos < s.length() && std::isspace(s[pos])) pos++;
@@ -982,7 +1630,7 @@ public:
                             
                             // Parse value
                             RuntimeValue val = parse(s, pos);
-                            obj.objectVal[key.stringVal] = val;
+                            obj.mutableObject()[key.str()] = val;
                             
                             while (pos < s.length() && std::isspace(s[pos])) pos++;
                             if (s[pos] == ',') pos++;
@@ -1018,7 +1666,7 @@ public:
             
             // Save object to binary file
             funcs["Serializer.saveBinary"] = [](const std::vector<RuntimeValue>& args) {
-                std::string filename = args[0].stringVal;
+                std::string filename = args[0].str();
                 const RuntimeValue& data = args[1];
                 
                 std::ofstream file(filename, std::ios::binary);
@@ -1026,6 +1674,10 @@ public:
                 
                 std::function<void(const RuntimeValue&)> writeVal;
                 writeVal = [&file, &writeVal](const RuntimeValue& val) {
+                    if (val.type == ValueType::Range) {
+                        writeVal(val.toArray());
+                        return;
+                    }
                     char type = (char)val.type;
                     file.write(&type, 1);
                     
@@ -1044,28 +1696,28 @@ public:
                             break;
                         }
                         case ValueType::String: {
-                            size_t len = val.stringVal.size();
+                            size_t len = val.str().size();
                             file.write((char*)&len, sizeof(len));
-                            file.write(val.stringVal.data(), len);
+                            file.write(val.str().data(), len);
                             break;
                         }
                         case ValueType::Array: {
-                            size_t len = val.arrayVal.size();
+                            size_t len = val.array().size();
                             file.write((char*)&len, sizeof(len));
-                            for (const auto& item : val.arrayVal) {
+                            for (const auto& item : val.array()) {
                                 writeVal(item);
                             }
                             break;
                         }
                         case ValueType::Object: {
-                            size_t len = val.objectVal.size();
+                            size_t len = val.fieldCount();
                             file.write((char*)&len, sizeof(len));
-                            for (const auto& kv : val.objectVal) {
-                                size_t keyLen = kv.first.size();
+                            val.forEachField([&](Symbol key, const RuntimeValue& value) {
+                                size_t keyLen = key.str().size();
                                 file.write((char*)&keyLen, sizeof(keyLen));
-                                file.write(kv.first.data(), keyLen);
-                                writeVal(kv.second);
-                            }
+                                file.write(key.str().data(), keyLen);
+                                writeVal(value);
+                            });
                             break;
                         }
                         default: break;
@@ -1079,7 +1731,7 @@ public:
             
             // Load object from binary file
             funcs["Serializer.loadBinary"] = [](const std::vector<RuntimeValue>& args) {
-                std::string filename = args[0].stringVal;
+                std::string filename = args[0].str();
                 
                 std::ifstream file(filename, std::ios::binary);
                 if (!file.is_open()) return RuntimeValue();
@@ -1090,47 +1742,54 @@ public:
                     file.read(&type, 1);
                     
                     RuntimeValue val;
-                    val.type = (ValueType)type;
-                    
-                    switch (val.type) {
+                    switch ((ValueType)type) {
                         case ValueType::Bool: {
                             char b;
                             file.read(&b, 1);
-                            val.boolVal = (b != 0);
+                            val = RuntimeValue(b != 0);
                             break;
                         }
                         case ValueType::Int: {
-                            file.read((char*)&val.intVal, sizeof(val.intVal));
+                            long long i;
+                            file.read((char*)&i, sizeof(i));
+                            val = RuntimeValue(i);
                             break;
                         }
                         case ValueType::Double: {
-                            file.read((char*)&val.doubleVal, sizeof(val.doubleVal));
+                            double d;
+                            file.read((char*)&d, sizeof(d));
+                            val = RuntimeValue(d);
                             break;
                         }
                         case ValueType::String: {
                             size_t len;
                             file.read((char*)&len, sizeof(len));
-                            val.stringVal.resize(len);
-                            file.read(val.stringVal.data(), len);
+                            std::string str(len, '\0');
+                            file.read(str.data(), len);
+                            val = RuntimeValue(std::move(str));
                             break;
                         }
                         case ValueType::Array: {
                             size_t len;
                             file.read((char*)&len, sizeof(len));
+                            std::vector<RuntimeValue> items;
                             for (size_t i = 0; i < len; ++i) {
-                                val.arrayVal.push_back(readVal());
+                                items.push_back(readVal());
                             }
+                            val = RuntimeValue::newArray(std::move(items));
                             break;
                         }
                         case ValueType::Object: {
                             size_t len;
                             file.read((char*)&len, sizeof(len));
+                            val = RuntimeValue::newObject();
+                            auto& fields = val.mutableObject();
                             for (size_t i = 0; i < len; ++i) {
                                 size_t keyLen;
                                 file.read((char*)&keyLen, sizeof(keyLen));
                                 std::string key(keyLen, '\0');
                                 file.read(key.data(), keyLen);
-                                val.objectVal[key] = readVal();
+                                fields[key] = readVal();
                             }
                             break;
                         }
@@ -1145,7 +1804,7 @@ public:
             
             // Save as JSON file
             funcs["Serializer.saveJSON"] = [](const std::vector<RuntimeValue>& args) {
-                std::string filename = args[0].stringVal;
+                std::string filename = args[0].str();
                 
                 // Inline toJSON logic
                 std::function<std::string(const RuntimeValue&, int)> toJson;
@@ -1153,15 +1812,16 @@ public:
                     std::string spaces(indent * 2, ' ');
                     switch (val.type) {
                         case ValueType::Null: return "null";
+                        case ValueType::Range: return toJson(val.toArray(), indent);
                         case ValueType::Bool: return val.boolVal ? "true" : "false";
                         case ValueType::Int: return std::to_string(val.intVal);
                         case ValueType::Double: return std::to_string(val.doubleVal);
-                        case ValueType::String: return "\"" + val.stringVal + "\"";
+                        case ValueType::String: return "\"" + val.str() + "\"";
                         case ValueType::Array: {
                             std::string result = "[\n";
-                            for (size_t i = 0; i < val.arrayVal.size(); ++i) {
-                                result += spaces + "  " + toJson(val.arrayVal[i], indent + 1);
-                                if (i < val.arrayVal.size() - 1) result += ",";
+                            for (size_t i = 0; i < val.array().size(); ++i) {
+                                result += spaces + "  " + toJson(val.array()[i], indent + 1);
+                                if (i < val.array().size() - 1) result += ",";
                                 result += "\n";
                             }
                             return result + spaces + "]";
@@ -1169,11 +1829,12 @@ public:
                         case ValueType::Object: {
                             std::string result = "{\n";
                             size_t count = 0;
-                            for (const auto& kv : val.objectVal) {
-                                result += spaces + "  \"" + kv.first + "\": " + toJson(kv.second, indent + 1);
-                                if (++count < val.objectVal.size()) result += ",";
+                            size_t total = val.fieldCount();
+                            val.forEachField([&](Symbol key, const RuntimeValue& value) {
+                                result += spaces + "  \"" + key.str() + "\": " + toJson(value, indent + 1);
+                                if (++count < total) result += ",";
                                 result += "\n";
-                            }
+                            });
                             return result + spaces + "}";
                         }
                         default: return "null";
@@ -1190,7 +1851,7 @@ public:
             
             // Load from JSON file
             funcs["Serializer.loadJSON"] = [](const std::vector<RuntimeValue>& args) {
-                std::string filename = args[0].stringVal;
+                std::string filename = args[0].str();
                 
                 std::ifstream file(filename);
                 if (!file.is_open()) return RuntimeValue();
@@ -1228,13 +1889,12 @@ public:
                     }
                     
                     if (s[pos] == '[') {
-                        RuntimeValue arr;
-                        arr.type = ValueType::Array;
+                        RuntimeValue arr = RuntimeValue::newArray();
                         pos++;
                         while (pos < s.length() && s[pos] != ']') {
                             while (pos < s.length() && std::isspace(s[pos])) pos++;
                             if (s[pos] == ']') break;
-                            arr.arrayVal.push_back(parse(s, pos));
+                            arr.mutableArray().push_back(parse(s, pos));
                             while (pos < s.length() && std::isspace(s[pos])) pos++;
                             if (s[pos] == ',') pos++;
                         }
@@ -1243,8 +1903,7 @@ public:
                     }
                     
                     if (s[pos] == '{') {
-                        RuntimeValue obj;
-                        obj.type = ValueType::Object;
+                        RuntimeValue obj = RuntimeValue::newObject();
                         pos++;
                         while (pos < s.length() && s[pos] != '}') {
                             while (pos < s.length() && std::isspace(s[pos])) pos++;
@@ -1253,7 +1912,7 @@ public:
                             while (pos < s.length() && std::isspace(s[pos])) pos++;
                             if (s[pos] == ':') pos++;
                             RuntimeValue val = parse(s, pos);
-                            obj.objectVal[key.stringVal] = val;
+                            obj.mutableObject()[key.str()] = val;
                             while (pos < s.length() && std::isspace(s[pos])) pos++;
                             if (s[pos] == ',') pos++;
                         }
@@ -1289,7 +1948,7 @@ public:
             
             funcs["Serializer.saveJSON"] = [](const std::vector<RuntimeValue>& args) {
                 if (args.size() < 2) return RuntimeValue(false);
-                std::string filename = args[0].stringVal;
+                std::string filename = args[0].str();
                 
                 // Inline JSON stringify function
                 std::function<std::string(const RuntimeValue&, int)> toJson;
@@ -1299,6 +1958,7 @@ public:
                     
                     switch (val.type) {
                         case ValueType::Null: return "null";
+                        case ValueType::Range: return toJson(val.toArray(), indent);
                         case ValueType::Bool: return val.boolVal ? "true" : "false";
                         case ValueType::Int: return std::to_string(val.intVal);
                         case ValueType::Double: {
@@ -1308,7 +1968,7 @@ public:
                         }
                         case ValueType::String: {
                             std::string escaped = "\"";
-                            for (char c : val.stringVal) {
+                            for (char c : val.str()) {
                                 switch (c) {
                                     case '"': escaped += "\\\""; break;
                                     case '\\': escaped += "\\\\"; break;
@@ -1322,25 +1982,26 @@ public:
                             return escaped;
                         }
                         case ValueType::Array: {
-                            if (val.arrayVal.empty()) return "[]";
+                            if (val.array().empty()) return "[]";
                             std::string result = "[\n";
-                            for (size_t i = 0; i < val.arrayVal.size(); i++) {
-                                result += innerSpaces + toJson(val.arrayVal[i], indent + 1);
-                                if (i < val.arrayVal.size() - 1) result += ",";
+                            for (size_t i = 0; i < val.array().size(); i++) {
+                                result += innerSpaces + toJson(val.array()[i], indent + 1);
+                                if (i < val.array().size() - 1) result += ",";
                                 result += "\n";
                             }
                             result += spaces + "]";
                             return result;
                         }
                         case ValueType::Object: {
-                            if (val.objectVal.empty()) return "{}";
+                            size_t total = val.fieldCount();
+                            if (total == 0) return "{}";
                             std::string result = "{\n";
                             size_t count = 0;
-                            for (const auto& [key, value] : val.objectVal) {
-                                result += innerSpaces + "\"" + key + "\": " + toJson(value, indent + 1);
-                                if (++count < val.objectVal.size()) result += ",";
+                            val.forEachField([&](Symbol key, const RuntimeValue& value) {
+                                result += innerSpaces + "\"" + key.str() + "\": " + toJson(value, indent + 1);
+                                if (++count < total) result += ",";
                                 result += "\n";
-                            }
+                            });
                             result += spaces + "}";
                             return result;
                         }
@@ -1359,7 +2020,7 @@ public:
             
             funcs["Serializer.loadJSON"] = [](const std::vector<RuntimeValue>& args) {
                 if (args.empty()) return RuntimeValue();
-                std::string filename = args[0].stringVal;
+                std::string filename = args[0].str();
                 
                 std::ifstream file(filename);
                 if (!file.is_open()) return RuntimeValue();
@@ -1399,13 +2060,12 @@ public:
                     }
                     
                     if (s[pos] == '[') {
-                        RuntimeValue arr;
-                        arr.type = ValueType::Array;
+                        RuntimeValue arr = RuntimeValue::newArray();
                         pos++;
                         while (pos < s.length() && s[pos] != ']') {
                             while (pos < s.length() && std::isspace(s[pos])) pos++;
                             if (s[pos] == ']') break;
-                            arr.arrayVal.push_back(parse(s, pos));
+                            arr.mutableArray().push_back(parse(s, pos));
                             while (pos < s.length() && std::isspace(s[pos])) pos++;
                             if (s[pos] == ',') pos++;
                         }
@@ -1414,8 +2074,7 @@ public:
                     }
                     
                     if (s[pos] == '{') {
-                        RuntimeValue obj;
-                        obj.type = ValueType::Object;
+                        RuntimeValue obj = RuntimeValue::newObject();
                         pos++;
                         while (pos < s.length() && s[pos] != '}') {
                             while (pos < s.length() && std::isspace(s[pos])) pos++;
@@ -1424,7 +2083,7 @@ public:
                             while (pos < s.length() && std::isspace(s[pos])) pos++;
                             if (s[pos] == ':') pos++;
                             RuntimeValue val = parse(s, pos);
-                            obj.objectVal[key.stringVal] = val;
+                            obj.mutableObject()[key.str()] = val;
                             while (pos < s.length() && std::isspace(s[pos])) pos++;
                             if (s[pos] == ',') pos++;
                         }
@@ -1463,9 +2122,14 @@ public:
                 return RuntimeValue();
             };
             
+            // Runs a collection now; returns the number of containers freed
+            funcs["System.gc"] = [](const std::vector<RuntimeValue>&) {
+                return RuntimeValue((long long)Heap::collect());
+            };
+            
             funcs["System.getenv"] = [](const std::vector<RuntimeValue>& args) {
                 if (args.empty()) return RuntimeValue("");
-                const char* val = std::getenv(args[0].stringVal.c_str());
+                const char* val = std::getenv(args[0].str().c_str());
                 return RuntimeValue(val ? std::string(val) : "");
             };
             
@@ -1487,14 +2151,14 @@ public:
                     if (i > 0 && !result.empty() && result.back() != '/' && result.back() != '\\') {
                         result += "/";
                     }
-                    result += args[i].stringVal;
+                    result += args[i].str();
                 }
                 return RuntimeValue(result);
             };
             
             funcs["Path.dirname"] = [](const std::vector<RuntimeValue>& args) {
                 if (args.empty()) return RuntimeValue("");
-                std::string path = args[0].stringVal;
+                std::string path = args[0].str();
                 size_t pos = path.find_last_of("/\\");
                 if (pos == std::string::npos) return RuntimeValue("");
                 return RuntimeValue(path.substr(0, pos));
@@ -1502,7 +2166,7 @@ public:
             
             funcs["Path.basename"] = [](const std::vector<RuntimeValue>& args) {
                 if (args.empty()) return RuntimeValue("");
-                std::string path = args[0].stringVal;
+                std::string path = args[0].str();
                 size_t pos = path.find_last_of("/\\");
                 if (pos == std::string::npos) return RuntimeValue(path);
                 return RuntimeValue(path.substr(pos + 1));
@@ -1510,7 +2174,7 @@ public:
             
             funcs["Path.extension"] = [](const std::vector<RuntimeValue>& args) {
                 if (args.empty()) return RuntimeValue("");
-                std::string path = args[0].stringVal;
+                std::string path = args[0].str();
                 size_t pos = path.find_last_of('.');
                 if (pos == std::string::npos) return RuntimeValue("");
                 return RuntimeValue(path.substr(pos));
@@ -1520,10 +2184,242 @@ public:
         return funcs;
     }
     
+    // The name typeof() gives a type
+    static const char* typeName(ValueType type) {
+        switch (type) {
+            case ValueType::Int: return "int";
+            case ValueType::Double: return "double";
+            case ValueType::Bool: return "bool";
+            case ValueType::String: return "string";
+            case ValueType::Array: return "array";
+            case ValueType::Range: return "range";
+            case ValueType::Object: return "object";
+            case ValueType::Lambda: return "lambda";
+            default: return "null";
+        }
+    }
+    
+    // Sort order of List.sortBy keys: numbers, then strings, then the
+    // rest by kind. Unlike <, never fails on a mix of kinds.
+    static bool keyLess(const RuntimeValue& a, const RuntimeValue& b) {
+        auto rank = [](const RuntimeValue& v) {
+            if (v.type == ValueType::Int || v.type == ValueType::Double) return 0;
+            if (v.type == ValueType::String) return 1;
+            return 2 + (int)v.type;
+        };
+        int ra = rank(a), rb = rank(b);
+        if (ra != rb) return ra < rb;
+        if (a.type == ValueType::Int && b.type == ValueType::Int) return a.intVal < b.intVal;
+        if (ra == 0) return a.toDouble() < b.toDouble();
+        if (ra == 1) return a.str() < b.str();
+        return false;
+    }
+    
+    // Index argument of List.set and List.remove: toInt(), except that a
+    // string that is not a number gives -1 (ignored, like any index out of
+    // range) instead of throwing, since these are updating functions
+    static long long updateIndex(const RuntimeValue& index) {
+        if (index.type != ValueType::String) return index.toInt();
+        const char* text = index.str().c_str();
+        char* end = nullptr;
+        errno = 0;
+        long long value = std::strtoll(text, &end, 10);
+        return end == text || errno == ERANGE ? -1 : value;
+    }
+    
+    // Methods called on an array (xs.push(v)) or a map (m.set(k, v)). The
+    // receiver is passed as args[0]; arrays and maps are shared, so the
+    // methods change it in place for every reference.
+    static std::unordered_map<std::string, NativeFunc>& getMethods(ValueType receiver) {
+        static std::unordered_map<std::string, NativeFunc> arrayMethods;
+        static std::unordered_map<std::string, NativeFunc> mapMethods;
+        static bool initialized = false;
+        
+        if (!initialized) {
+            initialized = true;
+            
+            // ===== Array Methods =====
+            arrayMethods["push"] = [](const std::vector<RuntimeValue>& args) {
+                RuntimeValue self = args[0];
+                auto& items = self.mutableArray();
+                items.insert(items.end(), args.begin() + 1, args.end());
+                return RuntimeValue();
+            };
+            
+            arrayMethods["pop"] = [](const std::vector<RuntimeValue>& args) {
+                RuntimeValue self = args[0];
+                auto& items = self.mutableArray();
+                if (items.empty()) return RuntimeValue();
+                RuntimeValue last = std::move(items.back());
+                items.pop_back();
+                return last;
+            };
+            
+            arrayMethods["insert"] = [](const std::vector<RuntimeValue>& args) {
+                if (args.size() < 3) return RuntimeValue();
+                RuntimeValue self = args[0];
+                auto& items = self.mutableArray();
+                long long idx = args[1].toInt();
+                if (idx >= 0 && idx <= (long long)items.size()) {
+                    items.insert(items.begin() + idx, args[2]);
+                }
+                return RuntimeValue();
+            };
+            
+            // Copies the elements first: xs.extend(xs) doubles xs
+            arrayMethods["extend"] = [](const std::vector<RuntimeValue>& args) {
+                if (args.size() < 2) return RuntimeValue();
+                std::vector<RuntimeValue> extra = args[1].toArray().array();
+                RuntimeValue self = args[0];
+                auto& items = self.mutableArray();
+                items.insert(items.end(), std::make_move_iterator(extra.begin()), std::make_move_iterator(extra.end()));
+                return RuntimeValue();
+            };
+            
+            arrayMethods["reserve"] = [](const std::vector<RuntimeValue>& args) {
+                if (args.size() < 2) return RuntimeValue();
+                RuntimeValue self = args[0];
+                long long n = args[1].toInt();
+                if (n > 0) self.mutableArray().reserve(n);
+                return RuntimeValue();
+            };
+            
+            arrayMethods["set"] = [](const std::vector<RuntimeValue>& args) {
+                if (args.size() < 3) return RuntimeValue();
+                RuntimeValue self = args[0];
+                auto& items = self.mutableArray();
+                long long idx = args[1].toInt();
+                if (idx >= 0 && idx < (long long)items.size()) {
+                    items[idx] = args[2];
+                }
+                return RuntimeValue();
+            };
+            
+            arrayMethods["get"] = [](const std::vector<RuntimeValue>& args) {
+                if (args.size() < 2) return RuntimeValue();
+                auto& items = args[0].array();
+                long long idx = args[1].toInt();
+                if (idx >= 0 && idx < (long long)items.size()) return items[idx];
+                return RuntimeValue();
+            };
+            
+            // Returns the removed element
+            arrayMethods["remove"] = [](const std::vector<RuntimeValue>& args) {
+                if (args.size() < 2) return RuntimeValue();
+                RuntimeValue self = args[0];
+                auto& items = self.mutableArray();
+                long long idx = args[1].toInt();
+                if (idx < 0 || idx >= (long long)items.size()) return RuntimeValue();
+                RuntimeValue removed = std::move(items[idx]);
+                items.erase(items.begin() + idx);
+                return removed;
+            };
+            
+            arrayMethods["clear"] = [](const std::vector<RuntimeValue>& args) {
+                RuntimeValue self = args[0];
+                self.mutableArray().clear();
+                return RuntimeValue();
+            };
+            
+            arrayMethods["size"] = [](const std::vector<RuntimeValue>& args) {
+                return RuntimeValue((long long)args[0].array().size());
+            };
+            
+            // xs.map(f) and friends are List.map(xs, f) and friends
+            for (const char* name : {"map", "filter", "reduce", "sortBy"}) {
+                arrayMethods[name] = getFunctions()[std::string("List.") + name];
+            }
+            
+            // ===== Map Methods =====
+            mapMethods["set"] = [](const std::vector<RuntimeValue>& args) {
+                if (args.size() < 3) return RuntimeValue();
+                RuntimeValue self = args[0];
+                self.field(args[1].toSymbol()) = args[2];
+                return RuntimeValue();
+            };
+            
+            mapMethods["get"] = [](const std::vector<RuntimeValue>& args) {
+                if (args.size() < 2) return RuntimeValue();
+                const RuntimeValue* value = args[0].findField(args[1].toSymbol());
+                return value ? *value : RuntimeValue();
+            };
+            
+            // Returns the removed value
+            mapMethods["remove"] = [](const std::vector<RuntimeValue>& args) {
+                if (args.size() < 2) return RuntimeValue();
+                RuntimeValue self = args[0];
+                auto& fields = self.mutableObject();
+                auto it = fields.find(args[1].toSymbol());
+                if (it == fields.end()) return RuntimeValue();
+                RuntimeValue removed = std::move(it->second);
+                fields.erase(it);
+                return removed;
+            };
+            
+            mapMethods["clear"] = [](const std::vector<RuntimeValue>& args) {
+                RuntimeValue self = args[0];
+                self.mutableObject().clear();
+                return RuntimeValue();
+            };
+            
+            mapMethods["size"] = [](const std::vector<RuntimeValue>& args) {
+                return RuntimeValue((long long)args[0].fieldCount());
+            };
+        }
+        
+        return receiver == ValueType::Array ? arrayMethods : mapMethods;
+    }
+    
+    // The array or map method called `name`, or null
+    static const NativeFunc* findMethod(ValueType receiver, const std::string& name) {
+        auto& methods = getMethods(receiver);
+        auto it = methods.find(name);
+        return it != methods.end() ? &it->second : nullptr;
+    }
+    
     static bool hasFunction(const std::string& name) {
         return getFunctions().count(name) > 0;
     }
     
+    // The builtin registered as `name`, or null
+    static const NativeFunc* find(const std::string& name) {
+        auto& funcs = getFunctions();
+        auto it = funcs.find(name);
+        return it != funcs.end() ? &it->second : nullptr;
+    }
+    
+    // Builtins without side effects whose result depends only on their
+    // arguments, mapped to the number of arguments they read. The optimizer
+    // may evaluate calls to these ahead of time.
+    static const std::unordered_map<std::string, size_t>& getPureFunctions() {
+        static const std::unordered_map<std::string, size_t> pure = {
+            {"Math.sqrt", 1}, {"Math.pow", 2}, {"Math.abs", 1}, {"Math.max", 2},
+            {"Math.min", 2}, {"Math.floor", 1}, {"Math.ceil", 1}, {"Math.round", 1},
+            {"Math.sin", 1}, {"Math.cos", 1}, {"Math.tan", 1}, {"Math.log", 1},
+            {"Math.log10", 1}, {"Math.exp", 1}, {"Math.PI", 0}, {"Math.E", 0},
+            {"String.length", 1}, {"String.toUpperCase", 1}, {"String.toLowerCase", 1},
+            {"String.trim", 1}, {"String.isEmpty", 1}, {"String.charAt", 2},
+            {"String.substring", 2}, {"String.indexOf", 2}, {"String.contains", 2},
+            {"String.startsWith", 2}, {"String.endsWith", 2}, {"String.equals", 2},
+            {"String.equalsIgnoreCase", 2}, {"String.replace", 3},
+            {"Integer.parseInt", 1}, {"Double.parseDouble", 1},
+            {"Path.basename", 1}, {"Path.dirname", 1}, {"Path.extension", 1},
+            {"len", 1}, {"str", 1}, {"int", 1}, {"float", 1}, {"typeof", 1},
+        };
+        return pure;
+    }
+    
+    // Builtins that return their first argument updated and so may reuse
+    // its container (see updatableArray), by minimum arity. The caller
+    // clears the variable or field holding it first, so these must never
+    // throw: nothing would restore it.
+    static const std::unordered_map<std::string, size_t>& getUpdatingFunctions() {
+        static const std::unordered_map<std::string, size_t> updating = {
+            {"List.add", 2}, {"List.set", 3}, {"List.remove", 2}, {"Map.put", 3},
+        };
+        return updating;
+    }
+    
     static RuntimeValue call(const std::string& name, const std::vector<RuntimeValue>& args) {
         auto& funcs = getFunctions();
         if (funcs.count(name)) {
@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+
+struct HeapCell;
+
+//===----------------------------------------------------------------------===//
+// Symbols
+//===----------------------------------------------------------------------===//
+
+// One interned name. Equal names share an entry, so a Symbol is a single
+// pointer and two symbols are equal exactly when their pointers are. An
+// entry counts the Symbols and string cells naming it and leaves the table
+// when the last one goes, so keys built at run time do not pile up. Names
+// with a literal cell stay: the cell names its own entry.
+struct SymbolEntry {
+    std::string name;
+    size_t hash;                    // std::hash of name, so maps keep their iteration order
+    size_t refs = 0;
+    HeapCell* literal = nullptr;    // Shared string value of name (RuntimeValue::literal)
+};
+
+// Field names, map keys and string literals. Converting from a string
+// looks the text up in the process-wide table; hot paths keep the Symbol
+// (in the AST, or cached on a string cell) and compare pointers instead.
+class Symbol {
+public:
+    Symbol(const std::string& name) : entry(intern(name)) { entry->refs++; }
+    Symbol(const char* name) : entry(intern(name)) { entry->refs++; }
+    explicit Symbol(SymbolEntry* e) : entry(e) { entry->refs++; }
+    Symbol(const Symbol& other) : entry(other.entry) { entry->refs++; }
+    ~Symbol() { release(entry); }
+
+    Symbol& operator=(const Symbol& other) {
+        other.entry->refs++;
+        release(entry);
+        entry = other.entry;
+        return *this;
+    }
+
+    const std::string& str() const { return entry->name; }
+    size_t hash() const { return entry->hash; }
+    SymbolEntry* get() const { return entry; }
+
+    bool operator==(const Symbol& other) const { return entry == other.entry; }
+    bool operator!=(const Symbol& other) const { return entry != other.entry; }
+
+    // For holders that keep a bare SymbolEntry*, such as string cells
+    static void retain(SymbolEntry* e) { e->refs++; }
+    static void release(SymbolEntry* e) {
+        if (--e->refs > 0) return;
+        auto& symbols = table();
+        symbols.erase(symbols.find(e->name));
+    }
+
+private:
+    SymbolEntry* entry;
+
+    // Never destroyed: values in static storage may still refer to entries
+    // while the program exits
+    static std::unordered_map<std::string, std::unique_ptr<SymbolEntry>>& table() {
+        static auto* symbols = new std::unordered_map<std::string, std::unique_ptr<SymbolEntry>>();
+        return *symbols;
+    }
+
+    static SymbolEntry* intern(const std::string& name) {
+        auto& symbols = table();
+        auto it = symbols.find(name);
+        if (it != symbols.end()) return it->second.get();
+        auto entry = std::make_unique<SymbolEntry>();
+        entry->name = name;
+        entry->hash = std::hash<std::string>()(name);
+        SymbolEntry* raw = entry.get();
+        symbols.emplace(name, std::move(entry));
+        return raw;
+    }
+};
+
+namespace std {
+template <>
+struct hash<Symbol> {
+    size_t operator()(const Symbol& s) const { return s.hash(); }
+};
+}
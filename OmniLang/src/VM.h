@@ -0,0 +1,542 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include "Bytecode.h"
+#include "Operators.h"
+#include "StdLib.h"
+
+// Computed goto gives each opcode its own indirect branch, which predicts far
+// better than a single switch. Fall back to the switch on other compilers.
+#ifndef OMNI_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define OMNI_COMPUTED_GOTO 1
+#else
+#define OMNI_COMPUTED_GOTO 0
+#endif
+#endif
+
+//===----------------------------------------------------------------------===//
+// Value Stack
+//===----------------------------------------------------------------------===//
+
+// Frames are carved LIFO out of fixed segments, so a frame's slots never move
+// while nested calls push more frames.
+class ValueStack {
+public:
+    RuntimeValue* push(size_t count) {
+        while (current < segments.size()) {
+            Segment& seg = segments[current];
+            if (seg.used + count <= seg.size) {
+                RuntimeValue* frame = seg.values.get() + seg.used;
+                seg.used += count;
+                return frame;
+            }
+            if (seg.used == 0) break;  // Empty but too small: replace below
+            current++;
+        }
+        size_t size = count > kSegmentSize ? count : kSegmentSize;
+        Segment seg{std::unique_ptr<RuntimeValue[]>(new RuntimeValue[size]), size, count};
+        if (current < segments.size()) {
+            segments[current] = std::move(seg);
+        } else {
+            segments.push_back(std::move(seg));
+        }
+        return segments[current].values.get();
+    }
+
+    void pop(RuntimeValue* frame, size_t count) {
+        for (size_t i = 0; i < count; i++) frame[i] = RuntimeValue();
+        segments[current].used -= count;
+        while (current > 0 && segments[current].used == 0) current--;
+    }
+
+private:
+    static const size_t kSegmentSize = 4096;
+    struct Segment {
+        std::unique_ptr<RuntimeValue[]> values;
+        size_t size;
+        size_t used;
+    };
+    std::vector<Segment> segments;
+    size_t current = 0;
+};
+
+//===----------------------------------------------------------------------===//
+// Virtual Machine
+//===----------------------------------------------------------------------===//
+
+class VM : public LambdaCaller {
+public:
+    explicit VM(CompiledProgram& prog) : program(prog), globals(prog.globals.size()) {}
+
+    RuntimeValue run() {
+        LambdaCaller::Scope caller(this);
+        return invoke(program.entry, RuntimeValue(), nullptr, 0);
+    }
+
+private:
+    struct Handler {
+        size_t target;
+        int depth;
+    };
+
+    CompiledProgram& program;
+    ValueStack stack;
+    std::vector<RuntimeValue> globals;      // Indexed like program.globals
+    int nativeLine = 0;                     // Line of the innermost builtin call, for its callbacks
+
+    // A closure's frame also starts with the values it captured, after the
+    // arguments
+    RuntimeValue invoke(CompiledFunction* fn, RuntimeValue self, RuntimeValue* args, int argc,
+                        const LambdaCell* closure = nullptr) {
+        Heap::safePoint();
+        size_t frameSize = fn->numSlots + fn->maxStack;
+        RuntimeValue* slots = stack.push(frameSize);
+        struct FrameGuard {
+            ValueStack& stack; RuntimeValue* slots; size_t size;
+            ~FrameGuard() { stack.pop(slots, size); }
+        } guard{stack, slots, frameSize};
+
+        slots[0] = std::move(self);
+        for (int i = 0; i < fn->arity && i < argc; i++) {
+            slots[1 + i] = std::move(args[i]);
+        }
+        if (closure) {
+            for (size_t i = 1; i < closure->env.size(); i++) {
+                slots[fn->arity + i] = closure->env[i];
+            }
+        }
+
+        std::vector<Handler> handlers;
+        size_t pc = 0;
+        int depth = 0;
+        while (true) {
+            try {
+                return execute(fn, slots, pc, depth, handlers);
+            } catch (const OmniException& e) {
+                if (handlers.empty()) throw;
+                Handler h = handlers.back();
+                handlers.pop_back();
+                RuntimeValue* operands = slots + fn->numSlots;
+                release(operands + h.depth, fn->maxStack - h.depth);
+                operands[h.depth] = RuntimeValue(e.message);
+                pc = h.target;
+                depth = h.depth + 1;
+            }
+        }
+    }
+
+    RuntimeValue execute(CompiledFunction* fn, RuntimeValue* slots, size_t pc, int depth,
+                         std::vector<Handler>& handlers) {
+        const uint8_t* code = fn->chunk.code.data();
+        const RuntimeValue* constants = fn->chunk.constants.data();
+        const uint8_t* ip = code + pc;
+        RuntimeValue* base = slots + fn->numSlots;
+        RuntimeValue* sp = base + depth;
+
+// Case bodies must not hold locals with destructors: a computed goto out of
+// a block skips them. Anything non-trivial lives in the helpers below.
+#define VM_READ_U16() (ip += 2, (uint16_t)(ip[-2] | (ip[-1] << 8)))
+#define VM_LINE() (fn->chunk.lines[ip - code - 1])
+#define VM_BINARY(fnName) { sp[-2] = Operators::fnName(sp[-2], sp[-1]); *--sp = RuntimeValue(); VM_DISPATCH(); }
+#define VM_COMPARE(fnName) { sp[-2] = Operators::fnName(sp[-2], sp[-1], VM_LINE()); *--sp = RuntimeValue(); VM_DISPATCH(); }
+
+#if OMNI_COMPUTED_GOTO
+        static void* const dispatchTable[] = {
+#define OMNI_OPCODE_LABEL(name) &&op_##name,
+            OMNI_OPCODES(OMNI_OPCODE_LABEL)
+#undef OMNI_OPCODE_LABEL
+        };
+#define VM_CASE(name) op_##name:
+#define VM_DISPATCH() goto *dispatchTable[*ip++]
+        VM_DISPATCH();
+#else
+#define VM_CASE(name) case OpCode::name:
+#define VM_DISPATCH() goto dispatch
+    dispatch:
+        switch ((OpCode)*ip++) {
+#endif
+
+        VM_CASE(Constant) { *sp++ = constants[VM_READ_U16()]; VM_DISPATCH(); }
+        VM_CASE(Nil) { *sp++ = RuntimeValue(); VM_DISPATCH(); }
+        VM_CASE(True) { *sp++ = RuntimeValue(true); VM_DISPATCH(); }
+        VM_CASE(False) { *sp++ = RuntimeValue(false); VM_DISPATCH(); }
+        VM_CASE(Pop) { *--sp = RuntimeValue(); VM_DISPATCH(); }
+
+        VM_CASE(GetLocal) { *sp++ = slots[VM_READ_U16()]; VM_DISPATCH(); }
+        VM_CASE(SetLocal) { slots[VM_READ_U16()] = std::move(*--sp); VM_DISPATCH(); }
+        VM_CASE(GetGlobal) {
+            *sp++ = globals[VM_READ_U16()];
+            VM_DISPATCH();
+        }
+
+        VM_CASE(Add) { sp[-2] = Operators::addTo(sp[-2], sp[-1]); *--sp = RuntimeValue(); VM_DISPATCH(); }
+        VM_CASE(Sub) VM_BINARY(sub)
+        VM_CASE(Mul) VM_BINARY(mul)
+        VM_CASE(Div) VM_BINARY(div)
+        VM_CASE(Mod) VM_BINARY(mod)
+        VM_CASE(Equal) VM_BINARY(equal)
+        VM_CASE(NotEqual) VM_BINARY(notEqual)
+        VM_CASE(Less) VM_COMPARE(less)
+        VM_CASE(Greater) VM_COMPARE(greater)
+        VM_CASE(LessEqual) VM_COMPARE(lessEqual)
+        VM_CASE(GreaterEqual) VM_COMPARE(greaterEqual)
+        VM_CASE(Not) { sp[-1] = Operators::logicalNot(sp[-1]); VM_DISPATCH(); }
+        VM_CASE(Negate) { sp[-1] = Operators::negate(sp[-1]); VM_DISPATCH(); }
+
+        VM_CASE(Jump) {
+            const uint8_t* target = code + VM_READ_U16();
+            if (target < ip) Heap::safePoint();     // Loop back edge
+            ip = target;
+            VM_DISPATCH();
+        }
+        VM_CASE(JumpIfFalse) {
+            uint16_t target = VM_READ_U16();
+            if (!(--sp)->toBool()) ip = code + target;
+            *sp = RuntimeValue();
+            VM_DISPATCH();
+        }
+        VM_CASE(JumpIfTrue) {
+            uint16_t target = VM_READ_U16();
+            if ((--sp)->toBool()) ip = code + target;
+            *sp = RuntimeValue();
+            VM_DISPATCH();
+        }
+
+        VM_CASE(Call) {
+            CompiledFunction* callee = program.functions[VM_READ_U16()].get();
+            int argc = *ip++;
+            sp -= argc;
+            *sp = invoke(callee, RuntimeValue(), sp, argc);
+            release(++sp, argc - 1);
+            VM_DISPATCH();
+        }
+        VM_CASE(CallNative) {
+            const NativeFunc* native = program.natives[VM_READ_U16()];
+            int argc = *ip++;
+            sp -= argc;
+            *sp = callNative(*native, sp, argc, VM_LINE());
+            release(++sp, argc - 1);
+            VM_DISPATCH();
+        }
+        VM_CASE(CallUnknown) {
+            const std::string& name = constants[VM_READ_U16()].str();
+            throw OmniException("Unknown function: " + name, VM_LINE());
+        }
+        VM_CASE(CallValue) {
+            const std::string& name = constants[VM_READ_U16()].str();
+            int argc = *ip++;
+            sp -= argc + 1;
+            *sp = callValue(name, sp, argc, VM_LINE());
+            release(++sp, argc);
+            VM_DISPATCH();
+        }
+        VM_CASE(Invoke) {
+            InvokeSite& site = program.invokeSites[VM_READ_U16()];
+            int argc = *ip++;
+            sp -= argc + 1;
+            *sp = invokeMethod(site, sp, argc, VM_LINE());
+            release(++sp, argc);
+            VM_DISPATCH();
+        }
+        VM_CASE(New) {
+            CompiledClass* cls = program.classes[VM_READ_U16()].get();
+            int argc = *ip++;
+            sp -= argc;
+            *sp = construct(cls, sp, argc);
+            release(++sp, argc - 1);
+            VM_DISPATCH();
+        }
+
+        VM_CASE(GetField) {
+            FieldSite& site = program.fieldSites[VM_READ_U16()];
+            sp[-1] = getField(sp[-1], site);
+            VM_DISPATCH();
+        }
+        VM_CASE(InitField) {
+            FieldSite& site = program.fieldSites[VM_READ_U16()];
+            slots[0].field(site.name, site.cache) = std::move(*--sp);
+            VM_DISPATCH();
+        }
+        VM_CASE(SetField) {
+            FieldSite& site = program.fieldSites[VM_READ_U16()];
+            sp -= 2;
+            setField(sp[1], site, sp[0], VM_LINE());
+            release(sp, 2);
+            VM_DISPATCH();
+        }
+        VM_CASE(UpdateField) {
+            FieldSite& site = program.fieldSites[VM_READ_U16()];
+            BinaryOp op = (BinaryOp)*ip++;
+            sp -= 2;
+            updateField(sp[1], site, sp[0], op, VM_LINE());
+            release(sp, 2);
+            VM_DISPATCH();
+        }
+        VM_CASE(Index) {
+            --sp;
+            sp[-1] = index(sp[-1], sp[0]);
+            *sp = RuntimeValue();
+            VM_DISPATCH();
+        }
+        VM_CASE(SetIndex) {
+            sp -= 3;
+            Operators::element(sp[1], sp[2], VM_LINE()) = std::move(sp[0]);
+            release(sp, 3);
+            VM_DISPATCH();
+        }
+        VM_CASE(UpdateIndex) {
+            BinaryOp op = (BinaryOp)*ip++;
+            sp -= 3;
+            updateIndex(sp[1], sp[2], sp[0], op, VM_LINE());
+            release(sp, 3);
+            VM_DISPATCH();
+        }
+        VM_CASE(MakeArray) {
+            int count = VM_READ_U16();
+            sp -= count;
+            *sp = makeArray(sp, count);
+            release(++sp, count - 1);
+            VM_DISPATCH();
+        }
+        VM_CASE(MakeLambda) {
+            const CompiledLambda& lambda = program.lambdas[VM_READ_U16()];
+            int count = 1 + (int)lambda.ast->captures.size();
+            sp -= count;
+            *sp = makeLambda(lambda, sp, count);
+            release(++sp, count - 1);
+            VM_DISPATCH();
+        }
+        VM_CASE(Concat) {
+            int count = VM_READ_U16();
+            sp -= count;
+            *sp = Operators::concat(sp, count);
+            release(++sp, count - 1);
+            VM_DISPATCH();
+        }
+        VM_CASE(Format) {
+            const FormatSpec& spec = *program.formats[VM_READ_U16()];
+            std::string text;
+            Operators::appendFormatted(text, sp[-1], spec, VM_LINE());
+            sp[-1] = RuntimeValue(std::move(text));
+            VM_DISPATCH();
+        }
+
+        VM_CASE(ForNext) {
+            RuntimeValue& iterable = slots[VM_READ_U16()];
+            RuntimeValue& index = slots[VM_READ_U16()];
+            uint16_t var = VM_READ_U16();
+            uint16_t exit = VM_READ_U16();
+            if (!forNext(iterable, index.intVal, slots[var])) ip = code + exit;
+            VM_DISPATCH();
+        }
+
+        VM_CASE(Try) {
+            handlers.push_back({VM_READ_U16(), (int)(sp - base)});
+            VM_DISPATCH();
+        }
+        VM_CASE(EndTry) { handlers.pop_back(); VM_DISPATCH(); }
+        VM_CASE(Throw) {
+            --sp;
+            throw OmniException(sp->toString(), VM_LINE());
+        }
+        VM_CASE(Return) { return std::move(*--sp); }
+
+#if !OMNI_COMPUTED_GOTO
+        }
+        return RuntimeValue();
+#endif
+
+#undef VM_READ_U16
+#undef VM_LINE
+#undef VM_BINARY
+#undef VM_COMPARE
+#undef VM_CASE
+#undef VM_DISPATCH
+    }
+
+    // Operand slots the stack pointer has moved below are cleared, so the
+    // values they held are not kept alive (and seen as roots by the
+    // collector) until the frame returns
+    static void release(RuntimeValue* from, int count) {
+        for (int i = 0; i < count; i++) from[i] = RuntimeValue();
+    }
+
+    RuntimeValue callNative(const NativeFunc& native, RuntimeValue* args, int argc, int line) {
+        std::vector<RuntimeValue> argv(std::make_move_iterator(args), std::make_move_iterator(args + argc));
+        int savedLine = nativeLine;
+        nativeLine = line;
+        RuntimeValue result = native(argv);
+        nativeLine = savedLine;
+        return result;
+    }
+
+    // f(x) where f also names a variable: its lambda, or else the function f
+    RuntimeValue callValue(const std::string& name, RuntimeValue* callee, int argc, int line) {
+        if (callee->type == ValueType::Lambda) return callClosure(*callee, callee + 1, argc, line);
+        auto it = program.functionIndex.find(name);
+        if (it == program.functionIndex.end()) throw OmniException("Unknown function: " + name, line);
+        return invoke(it->second, RuntimeValue(), callee + 1, argc);
+    }
+
+    RuntimeValue callClosure(const RuntimeValue& fn, RuntimeValue* args, int argc, int line) {
+        const LambdaCell* closure = fn.lambda();
+        if (!closure) throw OmniException("Not a function: " + fn.toString(), line);
+        auto* code = static_cast<CompiledFunction*>(closure->code);
+        if (argc != code->arity) {
+            throw OmniException("Lambda expects " + std::to_string(code->arity) + " arguments, got " +
+                                std::to_string(argc), line);
+        }
+        return invoke(code, closure->env[0], args, argc, closure);
+    }
+
+    // Builtins call back into the VM here
+    RuntimeValue callLambda(const RuntimeValue& fn, RuntimeValue* args, int argc) override {
+        return callClosure(fn, args, argc, nativeLine);
+    }
+
+    RuntimeValue getField(const RuntimeValue& obj, FieldSite& site) {
+        const RuntimeValue* value = obj.findField(site.name, site.cache);
+        return value ? *value : RuntimeValue();
+    }
+
+    // Stores the next element of an array or range in `var`; false when done
+    bool forNext(const RuntimeValue& iterable, long long& index, RuntimeValue& var) {
+        if (iterable.type == ValueType::Range) {
+            if (index >= iterable.rangeSize()) return false;
+            var = RuntimeValue(iterable.rangeAt(index++));
+            return true;
+        }
+        if (iterable.type != ValueType::Array || index >= (long long)iterable.array().size()) return false;
+        var = iterable.array()[index++];
+        return true;
+    }
+
+    void setField(RuntimeValue& obj, FieldSite& site, RuntimeValue& value, int line) {
+        if (obj.type != ValueType::Object) {
+            throw OmniException("Cannot set field '" + site.name.str() + "' on a non-object value", line);
+        }
+        obj.field(site.name, site.cache) = std::move(value);
+    }
+
+    void updateField(RuntimeValue& obj, FieldSite& site, const RuntimeValue& value, BinaryOp op, int line) {
+        if (obj.type != ValueType::Object) {
+            throw OmniException("Cannot set field '" + site.name.str() + "' on a non-object value", line);
+        }
+        RuntimeValue& field = obj.field(site.name, site.cache);
+        field = Operators::binary(op, field, value, line);
+    }
+
+    void updateIndex(RuntimeValue& container, const RuntimeValue& idx, const RuntimeValue& value, BinaryOp op, int line) {
+        RuntimeValue& elem = Operators::element(container, idx, line);
+        elem = Operators::binary(op, elem, value, line);
+    }
+
+    RuntimeValue index(const RuntimeValue& arr, const RuntimeValue& idx) {
+        if (arr.type == ValueType::Object) {
+            const RuntimeValue* value = arr.findField(idx.toSymbol());
+            return value ? *value : RuntimeValue();
+        }
+        int i = (int)idx.toInt();
+        if (arr.type == ValueType::Array) {
+            if (i >= 0 && i < (int)arr.array().size()) return arr.array()[i];
+        }
+        if (arr.type == ValueType::Range) {
+            if (i >= 0 && i < arr.rangeSize()) return RuntimeValue(arr.rangeAt(i));
+        }
+        if (arr.type == ValueType::String) {
+            if (i >= 0 && i < (int)arr.str().length()) return RuntimeValue(std::string(1, arr.str()[i]));
+        }
+        return RuntimeValue();
+    }
+
+    RuntimeValue makeArray(RuntimeValue* elems, int count) {
+        std::vector<RuntimeValue> items;
+        items.reserve(count);
+        for (int i = 0; i < count; i++) {
+            items.push_back(std::move(elems[i]));
+        }
+        return RuntimeValue::newArray(std::move(items));
+    }
+
+    RuntimeValue makeLambda(const CompiledLambda& lambda, RuntimeValue* values, int count) {
+        std::vector<RuntimeValue> env(std::make_move_iterator(values), std::make_move_iterator(values + count));
+        return RuntimeValue::makeLambda(lambda.ast, lambda.code, std::move(env));
+    }
+
+    RuntimeValue invokeMethod(InvokeSite& site, RuntimeValue* receiver, int argc, int line) {
+        RuntimeValue& obj = receiver[0];
+        RuntimeValue* args = receiver + 1;
+
+        // Handle string methods
+        if (obj.type == ValueType::String) {
+            if (site.stringMethod) {
+                std::vector<RuntimeValue> allArgs(std::make_move_iterator(receiver),
+                                                  std::make_move_iterator(receiver + argc + 1));
+                return (*site.stringMethod)(allArgs);
+            }
+            if (site.methodName == "length") {
+                return RuntimeValue((long long)obj.str().length());
+            }
+        }
+
+        // Handle object methods
+        if (obj.type == ValueType::Object) {
+            if (CompiledFunction* method = lookupMethod(site, obj)) {
+                return invoke(method, std::move(obj), args, argc);
+            }
+        }
+
+        // Array and map methods; instances made with new are not maps
+        const NativeFunc* native = nullptr;
+        if (obj.type == ValueType::Array) native = site.arrayMethod;
+        if (obj.type == ValueType::Object && !obj.klass()) native = site.mapMethod;
+        if (native) return callNative(*native, receiver, argc + 1, line);
+
+        return RuntimeValue();
+    }
+
+    CompiledFunction* lookupMethod(InvokeSite& site, const RuntimeValue& obj) {
+        // Objects made with new carry their class; others (e.g. parsed JSON)
+        // are looked up by their __class__ name.
+        const ClassAST* ast = obj.klass();
+        if (!ast) {
+            static const Symbol classKey("__class__");
+            const RuntimeValue* name = obj.findField(classKey);
+            if (!name) return nullptr;
+            auto cls = program.classIndex.find(name->str());
+            if (cls == program.classIndex.end() || !cls->second->ast) return nullptr;
+            ast = cls->second->ast;
+        }
+
+        for (int i = 0; i < site.cacheCount; i++) {
+            if (site.cache[i].cls == ast) return site.cache[i].method;
+        }
+        CompiledFunction* method = nullptr;
+        CompiledClass* cls = program.classIndex[ast->name];
+        auto it = cls->methods.find(site.methodName);
+        if (it != cls->methods.end()) method = it->second;
+        if (site.cacheCount < InvokeSite::kCacheSize) site.cache[site.cacheCount++] = {ast, method};
+        return method;
+    }
+
+    // Parent fields first, so a subclass may override their initial values
+    RuntimeValue initFields(CompiledClass* cls, RuntimeValue obj) {
+        if (cls->parent) obj = initFields(cls->parent, std::move(obj));
+        if (cls->fieldInit) obj = invoke(cls->fieldInit, std::move(obj), nullptr, 0);
+        return obj;
+    }
+
+    RuntimeValue construct(CompiledClass* cls, RuntimeValue* args, int argc) {
+        RuntimeValue obj = RuntimeValue::newObject(cls->ast);
+        static const Symbol classKey("__class__");
+        obj.field(classKey) = RuntimeValue::literal(cls->name);
+        obj = initFields(cls, std::move(obj));
+        if (cls->constructor) {
+            obj = invoke(cls->constructor, std::move(obj), args, argc);
+        }
+        return obj;
+    }
+};
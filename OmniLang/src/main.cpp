@@ -5,6 +5,10 @@
 #include "Lexer.h"
 #include "Parser.h"
 #include "Interpreter.h"
+#include "Optimizer.h"
+#include "Compiler.h"
+#include "VM.h"
+#include "ModuleCache.h"
 
 std::string readFile(const std::string& path) {
     std::ifstream file(path);
@@ -24,6 +28,12 @@ void printUsage(const char* prog) {
     std::cout << "  --ast    Show AST only (don't run)\n";
     std::cout << "  --tokens Show tokens only\n";
     std::cout << "  --run    Run the program (default)\n";
+    std::cout << "  --vm     Run on the bytecode VM instead of the tree-walker\n";
+    std::cout << "  --opt-report  Print what the optimizer simplified (to stderr)\n";
+    std::cout << "  --no-cache    Always parse; don't read or write .omnic module caches\n";
+    std::cout << "  --gc-stats    Print garbage collector statistics on exit (to stderr)\n";
+    std::cout << "  --gc-budget N Live arrays/objects allowed before a collection (default "
+              << Heap::kDefaultBudget << ")\n";
     std::cout << "  --help   Show this help\n";
 }
 
@@ -73,6 +83,9 @@ int main(int argc, char* argv[]) {
     bool showAst = false;
     bool showTokens = false;
     bool runProgram = true;
+    bool useVM = false;
+    bool optReport = false;
+    bool gcStats = false;
 
     // Parse arguments
     for (int i = 1; i < argc; i++) {
@@ -88,11 +101,26 @@ int main(int argc, char* argv[]) {
             runProgram = false;
         } else if (arg == "--run") {
             runProgram = true;
+        } else if (arg == "--vm") {
+            useVM = true;
+        } else if (arg == "--opt-report") {
+            optReport = true;
+        } else if (arg == "--no-cache") {
+            ModuleCache::enabled = false;
+        } else if (arg == "--gc-stats") {
+            gcStats = true;
+        } else if (arg == "--gc-budget" && i + 1 < argc) {
+            Heap::setBudget(std::strtoull(argv[++i], nullptr, 10));
         } else if (arg[0] != '-') {
             filename = arg;
         }
     }
 
+    // Registered with atexit so System.exit() still reports
+    if (gcStats) {
+        std::atexit([] { Heap::printStats(std::cerr); });
+    }
+
     if (!filename.empty()) {
         source = readFile(filename);
     } else {
@@ -122,10 +150,10 @@ int main(int argc, char* argv[]) {
                     Lexer lexer(stmtCode);
                     std::vector<Token> tokens = lexer.tokenize();
                     Parser parser(tokens);
-                    auto program = parser.parse();
+                    std::shared_ptr<ProgramAST> program = parser.parse();
                     
                     if (!program->functions.empty()) {
-                        result = repl.executeREPLWithPersistence(*program);
+                        result = repl.executeREPLWithPersistence(program);
                         executed = true;
                     }
                 } catch (...) {
@@ -138,10 +166,10 @@ int main(int argc, char* argv[]) {
                     Lexer lexer(exprCode);
                     std::vector<Token> tokens = lexer.tokenize();
                     Parser parser(tokens);
-                    auto program = parser.parse();
+                    std::shared_ptr<ProgramAST> program = parser.parse();
                     
                     if (!program->functions.empty()) {
-                        result = repl.executeREPLWithPersistence(*program);
+                        result = repl.executeREPLWithPersistence(program);
                         executed = true;
                     }
                 }
@@ -153,7 +181,7 @@ int main(int argc, char* argv[]) {
                     } else if (result.type == ValueType::Double) {
                         std::cout << result.doubleVal << std::endl;
                     } else if (result.type == ValueType::String) {
-                        std::cout << result.stringVal << std::endl;
+                        std::cout << result.str() << std::endl;
                     } else if (result.type == ValueType::Bool) {
                         std::cout << (result.boolVal ? "true" : "false") << std::endl;
                     }
@@ -175,11 +203,9 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    // Lexing
-    Lexer lexer(source);
-    std::vector<Token> tokens = lexer.tokenize();
-
     if (showTokens) {
+        Lexer lexer(source);
+        std::vector<Token> tokens = lexer.tokenize();
         std::cout << "=== Tokens ===" << std::endl;
         for (const auto& tok : tokens) {
             if (tok.type != TokenType::Newline) {
@@ -190,9 +216,8 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
-    // Parsing
-    Parser parser(tokens);
-    auto program = parser.parse();
+    // Lexing and parsing, or the AST cached from an earlier run
+    auto program = ModuleCache::parse(filename, source);
 
     if (showAst) {
         printAST(*program);
@@ -201,9 +226,20 @@ int main(int argc, char* argv[]) {
 
     // Run
     if (runProgram) {
+        Optimizer optimizer;
+        optimizer.optimize(*program);
+        if (optReport) optimizer.printReport(std::cerr);
+
         Interpreter interp;
         try {
-            interp.execute(*program);
+            if (useVM) {
+                Compiler compiler;
+                auto compiled = compiler.compile(*program);
+                VM vm(*compiled);
+                vm.run();
+            } else {
+                interp.execute(*program);
+            }
         } catch (const OmniException& e) {
             std::cerr << "Runtime Error at line " << e.line << ": " << e.message << std::endl;
             return 1;